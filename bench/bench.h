@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "raytracer.h"
+
+// minimal benchmark harness shared by the benchmark executables
+//
+// every benchmark is a callable doing a fixed number of operations per call. Results are written
+// as JSON, one object per benchmark with its time per operation and throughput, so they can be
+// compared across commits:
+//
+//   {"benchmarks": [{"name": "...", "iterations": N, "ns_per_op": X, "ops_per_s": Y}, ...]}
+
+// keep the compiler from optimising away a result or hoisting a computation out of the loop
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct BenchResult {
+    std::string name;
+
+    u64 iterations = 0;  // operations timed
+
+    f64 ns_per_op = 0.0;
+    f64 ops_per_s = 0.0;
+
+    // extra numeric fields, e.g. the thread count of a scaling run
+    std::vector<std::pair<std::string, f64>> fields;
+};
+
+inline std::ostream& WriteJSON(std::ostream& out, const std::vector<BenchResult>& results) {
+    out << "{\"benchmarks\": [";
+
+    for (std::size_t i = 0; i < results.size(); i++) {
+        const auto& r = results[i];
+
+        out << (i == 0 ? "" : ",") << "\n  {\"name\": \"" << r.name
+            << "\", \"iterations\": " << r.iterations << ", \"ns_per_op\": " << r.ns_per_op
+            << ", \"ops_per_s\": " << r.ops_per_s;
+
+        for (const auto& [key, value] : r.fields) {
+            out << ", \"" << key << "\": " << value;
+        }
+
+        out << "}";
+    }
+
+    return out << "\n]}" << newline;
+}
+
+class BenchRunner {
+   public:
+    // understands `--filter SUBSTRING`, `--min-time SECONDS`, `--threads N` and `--json FILE`
+    BenchRunner(int argc, char* argv[]) {
+        for (int i = 1; i < argc; i++) {
+            std::string_view arg{argv[i]};
+
+            if (arg == "--filter" && i + 1 < argc) {
+                filter_ = argv[++i];
+            } else if (arg == "--min-time" && i + 1 < argc) {
+                min_time_ = std::chrono::duration<f64>{std::stod(argv[++i])};
+            } else if (arg == "--threads" && i + 1 < argc) {
+                // 0 means one per hardware thread, as for `ThreadPool`
+                max_threads_ = static_cast<u32>(std::stoul(argv[++i]));
+
+                if (max_threads_ == 0) {
+                    max_threads_ = std::max(1u, std::thread::hardware_concurrency());
+                }
+            } else if (arg == "--json" && i + 1 < argc) {
+                json_path_ = argv[++i];
+            } else {
+                std::cerr << "usage: " << argv[0]
+                          << " [--filter SUBSTRING] [--min-time SECONDS] [--threads N]"
+                             " [--json FILE]"
+                          << newline;
+                std::exit(1);
+            }
+        }
+    }
+
+    bool Selected(std::string_view name) const {
+        return name.find(filter_) != std::string_view::npos;
+    }
+
+    // largest thread count of the scaling benchmarks
+    u32 max_threads() const { return max_threads_; }
+
+    // time `op`, which does `ops_per_call` operations per call: the iteration count is doubled
+    // until a run takes `min_time`, then the fastest of `kRepetitions` runs of that length is
+    // reported
+    template <typename F>
+    void Run(const std::string& name, F&& op, u64 ops_per_call = 1) {
+        if (!Selected(name)) {
+            return;
+        }
+
+        u64 iterations = 1;
+
+        while (Time(op, iterations) < min_time_ && iterations < (u64{1} << 40)) {
+            iterations *= 2;
+        }
+
+        Clock::duration best = Clock::duration::max();
+
+        for (u32 rep = 0; rep < kRepetitions; rep++) {
+            best = std::min(best, Time(op, iterations));
+        }
+
+        u64 ops = iterations * ops_per_call;
+
+        f64 ns = std::chrono::duration<f64, std::nano>(best).count();
+
+        Add(name, ops, ns / static_cast<f64>(ops));
+    }
+
+    // record a result measured by the caller
+    void Add(const std::string& name, u64 ops, f64 ns_per_op,
+             std::vector<std::pair<std::string, f64>> fields = {}) {
+        BenchResult result{name, ops, ns_per_op, 1e9 / ns_per_op, std::move(fields)};
+
+        std::clog << name << ": " << ns_per_op << " ns/op" << newline;
+
+        results_.push_back(std::move(result));
+    }
+
+    // write the JSON report to the --json file, or to stdout
+    int Finish() const {
+        if (json_path_.empty()) {
+            WriteJSON(std::cout, results_);
+            return std::cout ? 0 : 1;
+        }
+
+        std::ofstream out{json_path_};
+        WriteJSON(out, results_);
+
+        if (!out.flush()) {
+            std::cerr << "can't write " << json_path_ << newline;
+            return 1;
+        }
+
+        return 0;
+    }
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr u32 kRepetitions = 5;
+
+    template <typename F>
+    static Clock::duration Time(F& op, u64 iterations) {
+        auto start = Clock::now();
+
+        for (u64 i = 0; i < iterations; i++) {
+            op();
+        }
+
+        return Clock::now() - start;
+    }
+
+    std::string filter_;
+    std::chrono::duration<f64> min_time_{0.1};
+    u32 max_threads_ = std::max(1u, std::thread::hardware_concurrency());
+    std::string json_path_;
+
+    std::vector<BenchResult> results_;
+};
@@ -0,0 +1,111 @@
+// end-to-end benchmark: render the canonical scenes of scenes.h at a fixed resolution, sample
+// count and seed, on 1, 2, 4, ... up to --threads threads, and report wall time, primary and total
+// rays per second and the speedup over one thread. See `BenchRunner` for the options.
+//
+// every pixel sample has its own keyed random stream, so each run traces exactly the same rays
+// whatever the thread count, and runs of different builds are directly comparable
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "bench.h"
+#include "bvh.h"
+#include "camera.h"
+#include "material.h"
+#include "raytracer.h"
+#include "renderer.h"
+#include "renderobjectlist.h"
+#include "renderstats.h"
+#include "scenes.h"
+#include "threadpool.h"
+
+namespace {
+
+constexpr u32 kImageWidth = 384;
+constexpr u32 kImageHeight = 216;
+constexpr u32 kSamplesPerPixel = 16;
+constexpr u32 kSeed = 0;
+
+std::vector<u32> ThreadCounts(u32 max_threads) {
+    std::vector<u32> counts;
+
+    for (u32 n = 1; n < max_threads; n *= 2) {
+        counts.push_back(n);
+    }
+
+    counts.push_back(max_threads);
+
+    return counts;
+}
+
+void BenchScene(BenchRunner& runner, std::string_view name, SceneFn make_scene) {
+    using Clock = std::chrono::steady_clock;
+
+    RenderObjectList list;
+    MaterialTable materials;
+
+    auto build_start = Clock::now();
+
+    Camera camera = make_scene(list, materials, kImageWidth, kImageHeight);
+
+    ThreadPool build_pool{runner.max_threads()};
+    BVH world{std::move(list), BVHBuildOptions{.pool = &build_pool}};
+
+    f64 build_s = std::chrono::duration<f64>(Clock::now() - build_start).count();
+
+    const auto primary_rays =
+        static_cast<f64>(u64{kImageWidth} * kImageHeight * kSamplesPerPixel);
+
+    f64 single_thread_s = 0.0;
+
+    for (u32 num_threads : ThreadCounts(runner.max_threads())) {
+        ThreadPool pool{num_threads};
+
+        Renderer renderer{camera, pool, kSamplesPerPixel};
+        renderer.seed() = kSeed;
+
+        RenderStats stats;
+
+        auto start = Clock::now();
+
+        renderer.Render(world, materials, &stats);
+
+        f64 wall_s = std::chrono::duration<f64>(Clock::now() - start).count();
+
+        if (num_threads == 1) {
+            single_thread_s = wall_s;
+        }
+
+        const u64 rays = stats.rays;
+
+        f64 speedup = single_thread_s / wall_s;
+
+        runner.Add(std::string{name} + "/threads:" + std::to_string(num_threads), rays,
+                   1e9 * wall_s / static_cast<f64>(rays),
+                   {{"threads", num_threads},
+                    {"wall_s", wall_s},
+                    {"build_s", build_s},
+                    {"primary_rays_per_s", primary_rays / wall_s},
+                    {"total_rays_per_s", static_cast<f64>(rays) / wall_s},
+                    {"shadow_rays_per_s", static_cast<f64>(stats.shadow_rays) / wall_s},
+                    {"speedup", speedup},
+                    {"efficiency", speedup / num_threads}});
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    BenchRunner runner{argc, argv};
+
+    for (const auto& [name, make_scene] : kCanonicalScenes) {
+        if (runner.Selected(name)) {
+            BenchScene(runner, name, make_scene);
+        }
+    }
+
+    return runner.Finish();
+}
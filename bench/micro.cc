@@ -0,0 +1,203 @@
+// microbenchmarks of the intersection, scattering and sampling kernels, run with
+// `meson test --benchmark` or directly, see `BenchRunner` for the options
+
+#include <array>
+#include <cmath>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "2dshapes.h"
+#include "bench.h"
+#include "colour.h"
+#include "material.h"
+#include "rand.h"
+#include "ray.h"
+#include "raytracer.h"
+#include "renderobject.h"
+#include "renderobjectlist.h"
+#include "sphere.h"
+#include "vec3.h"
+
+namespace {
+
+// inputs are cycled through so the branch predictor can't learn a single one
+constexpr std::size_t kNumInputs = 1024;
+
+// rays from around the origin towards a unit sphere at -z, roughly half of them hit it
+std::vector<Ray> MakeRays() {
+    auto& rand = RandomGen::GenInstance();
+
+    std::vector<Ray> rays;
+    rays.reserve(kNumInputs);
+
+    for (std::size_t i = 0; i < kNumInputs; i++) {
+        Point3 origin = 0.1 * rand.UnitBallVec3();
+        Point3 target = Point3{0, 0, -3} + 1.4 * rand.UnitDiskVec3();
+
+        rays.emplace_back(origin, target - origin);
+    }
+
+    return rays;
+}
+
+// hit records on the unit sphere around the origin, seen from outside
+std::vector<HitRecord> MakeHitRecords(std::span<const Ray> rays) {
+    std::vector<HitRecord> records;
+    records.reserve(rays.size());
+
+    for (const auto& ray : rays) {
+        HitRecord hit_record;
+
+        hit_record.normal = -ray.direction();
+        hit_record.p = hit_record.normal;
+        hit_record.t = 1.0;
+        hit_record.front_face = true;
+
+        records.push_back(hit_record);
+    }
+
+    return records;
+}
+
+void BenchIntersection(BenchRunner& runner, std::span<const Ray> rays) {
+    std::size_t i = 0;
+
+    auto next_ray = [&]() -> const Ray& { return rays[i++ % rays.size()]; };
+
+    const Point3 centre{0, 0, -3};
+    const Interval ts{kSelfIntersectEps<f64>, kInf};
+
+    runner.Run("Ray::HitSphere", [&] { DoNotOptimize(next_ray().HitSphere(centre, 1.0)); });
+
+    runner.Run("Ray::HitPlane",
+               [&] { DoNotOptimize(next_ray().HitPlane(centre, Vec3{0.1, 0.2, 1.0}.normed())); });
+
+    Sphere sphere{centre, 1.0, 0};
+
+    runner.Run("Sphere::hit", [&] { DoNotOptimize(sphere.hit(next_ray(), ts)); });
+    runner.Run("Sphere::occluded", [&] { DoNotOptimize(sphere.occluded(next_ray(), ts)); });
+
+    Rectangle rectangle{Point3{-1, -1, -3}, 2 * Vec3::e_x, 2 * Vec3::e_y, 0};
+
+    runner.Run("Rectangle::hit", [&] { DoNotOptimize(rectangle.hit(next_ray(), ts)); });
+    runner.Run("Rectangle::occluded",
+               [&] { DoNotOptimize(rectangle.occluded(next_ray(), ts)); });
+
+    // spheres spread over the view, so lists see a mix of hits and misses
+    for (u32 n : {1, 4, 16, 64, 256}) {
+        auto& rand = RandomGen::GenInstance();
+
+        RenderObjectList list;
+
+        for (u32 k = 0; k < n; k++) {
+            Point3 c = Point3{0, 0, -6} + 3.0 * rand.UnitDiskVec3() + rand.UniformVec3(-1, 1);
+
+            list.Emplace<Sphere>(c, 0.3, 0);
+        }
+
+        runner.Run("RenderObjectList::hit/" + std::to_string(n),
+                   [&] { DoNotOptimize(list.hit(next_ray(), ts)); });
+        runner.Run("RenderObjectList::occluded/" + std::to_string(n),
+                   [&] { DoNotOptimize(list.occluded(next_ray(), ts)); });
+    }
+}
+
+void BenchMaterials(BenchRunner& runner, std::span<const Ray> rays) {
+    auto records = MakeHitRecords(rays);
+
+    std::size_t i = 0;
+
+    auto scatter = [&](const auto& mat) {
+        std::size_t k = i++ % rays.size();
+        DoNotOptimize(mat.Scatter(rays[k], records[k]));
+    };
+
+    Lambertian lambertian{Colour{0.5, 0.5, 0.5}};
+    Metal metal{Colour{0.8, 0.8, 0.8}, 0.3};
+    Dielectric dielectric{1.5, 0.0};
+
+    runner.Run("Lambertian::Scatter", [&] { scatter(lambertian); });
+    runner.Run("Metal::Scatter", [&] { scatter(metal); });
+    runner.Run("Dielectric::Scatter", [&] { scatter(dielectric); });
+
+    // the same, dispatched through the variant as the renderer does
+    MaterialTable materials;
+
+    std::array<MaterialId, 3> ids{materials.Add(lambertian), materials.Add(metal),
+                                  materials.Add(dielectric)};
+
+    for (auto& record : records) {
+        record.mat = ids[static_cast<std::size_t>(&record - records.data()) % ids.size()];
+    }
+
+    runner.Run("MaterialTable::Scatter", [&] { scatter(materials); });
+}
+
+void BenchSamplers(BenchRunner& runner) {
+    auto& rand = RandomGen::GenInstance();
+
+    const Vec3 normal = Vec3{0.3, 0.4, 0.5}.normed();
+
+    runner.Run("RandomGen::U64", [&] { DoNotOptimize(rand.U64()); });
+    runner.Run("RandomGen::Uniform", [&] { DoNotOptimize(rand.Uniform()); });
+    runner.Run("RandomGen::UnitSphereVec3", [&] { DoNotOptimize(rand.UnitSphereVec3()); });
+    runner.Run("RandomGen::UnitBallVec3", [&] { DoNotOptimize(rand.UnitBallVec3()); });
+    runner.Run("RandomGen::HemisphereVec3", [&] { DoNotOptimize(rand.HemisphereVec3(normal)); });
+    runner.Run("RandomGen::CosineHemisphereVec3",
+               [&] { DoNotOptimize(rand.CosineHemisphereVec3(normal)); });
+    runner.Run("RandomGen::UnitDiskVec3", [&] { DoNotOptimize(rand.UnitDiskVec3()); });
+
+    // batched samplers, reported per sample
+
+    constexpr u64 kBatch = 256;
+
+    std::vector<f64> uniforms(kBatch);
+    std::vector<Vec3> vecs(kBatch);
+
+    runner.Run(
+        "RandomGen::Uniform[256]",
+        [&] {
+            rand.Uniform(std::span{uniforms});
+            DoNotOptimize(uniforms.data());
+        },
+        kBatch);
+
+    runner.Run(
+        "RandomGen::UnitSphereVec3[256]",
+        [&] {
+            rand.UnitSphereVec3(std::span{vecs});
+            DoNotOptimize(vecs.data());
+        },
+        kBatch);
+
+    runner.Run(
+        "RandomGen::CosineHemisphereVec3[256]",
+        [&] {
+            rand.CosineHemisphereVec3(normal, std::span{vecs});
+            DoNotOptimize(vecs.data());
+        },
+        kBatch);
+
+    runner.Run(
+        "RandomGen::UnitDiskVec3[256]",
+        [&] {
+            rand.UnitDiskVec3(std::span{vecs});
+            DoNotOptimize(vecs.data());
+        },
+        kBatch);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    BenchRunner runner{argc, argv};
+
+    auto rays = MakeRays();
+
+    BenchIntersection(runner, rays);
+    BenchMaterials(runner, rays);
+    BenchSamplers(runner);
+
+    return runner.Finish();
+}
@@ -1,26 +1,78 @@
 #pragma once
 
 #include <cassert>
-#include <memory>
 #include <optional>
-#include <utility>
 
+#include "aabb.h"
 #include "interval.h"
+#include "lights.h"
 #include "ray.h"
 #include "raytracer.h"
 #include "renderobject.h"
+#include "renderstats.h"
 #include "vec3.h"
 
 class Rectangle : public RenderObject {
    public:
     Rectangle() = default;
 
-    Rectangle(Point3 origin, Vec3 a, Vec3 b, std::shared_ptr<Material> mat)
-        : origin_{origin}, a_{a}, b_{b}, normal_{cross(a, b).normed()}, mat_{std::move(mat)} {
+    Rectangle(Point3 origin, Vec3 a, Vec3 b, MaterialId mat)
+        : origin_{origin}, a_{a}, b_{b}, normal_{cross(a, b).normed()}, mat_{mat} {
         assert(is_zero(dot(a_, b_)));
     }
 
-    std::optional<HitRecord> hit(const Ray& ray, Interval ts) const override {
+    bool intersect(const Ray& ray, Interval ts, Intersection& isect) const override {
+        auto t_maybe = HitT(ray, ts);
+
+        if (!t_maybe.has_value()) {
+            return false;
+        }
+
+        isect.t = t_maybe.value();
+        isect.obj = this;
+        isect.instance = nullptr;
+        isect.prim = 0;
+
+        return true;
+    }
+
+    HitRecord interaction(const Ray& ray, const Intersection& isect) const override {
+        HitRecord hit_record;
+
+        hit_record.t = isect.t;
+        hit_record.front_face = dot(normal_, ray.direction()) > 0;
+        hit_record.p = ray.At(isect.t);
+        hit_record.mat = mat_;
+        hit_record.normal = normal_;
+
+        return hit_record;
+    }
+
+    bool occluded(const Ray& ray, Interval ts) const override {
+        return HitT(ray, ts).has_value();
+    }
+
+    AABB bounds() const override {
+        AABB box;
+
+        box.Extend(origin_);
+        box.Extend(origin_ + a_);
+        box.Extend(origin_ + b_);
+        box.Extend(origin_ + a_ + b_);
+
+        // the rectangle is flat, so give the box some thickness
+        return box.Padded(1e-4);
+    }
+
+    void AddLights(LightList& lights) const override {
+        lights.Add(*this, 0, RectangleShape{origin_, a_, b_}, mat_);
+    }
+
+   private:
+    // t at which the ray hits the rectangle inside `ts`
+    std::optional<f64> HitT(const Ray& ray, Interval ts) const {
+        IntersectionCounters::Count(PrimitiveKind::kRectangle);
+
         auto t_maybe = ray.HitPlane(origin_, normal_);
 
         if (!t_maybe.has_value()) {
@@ -38,22 +90,14 @@ class Rectangle : public RenderObject {
         f64 _a = dot(p - origin_, a_);
         f64 _b = dot(p - origin_, b_);
 
-        if (_a <= 0.0 || _b <= 0.0 || _a >= a_.norm() || _b >= b_.norm()) {
+        // _a and _b are the coordinates along a and b scaled by |a|^2 and |b|^2 respectively
+        if (_a <= 0.0 || _b <= 0.0 || _a >= a_.squared() || _b >= b_.squared()) {
             return std::nullopt;
         }
 
-        HitRecord hit_record;
-
-        hit_record.t = t;
-        hit_record.front_face = dot(normal_, ray.direction()) > 0;
-        hit_record.p = p;
-        hit_record.mat = mat_.get();
-        hit_record.normal = normal_;
-
-        return hit_record;
+        return t;
     }
 
-   private:
     Point3 origin_;
 
     Vec3 a_;
@@ -61,5 +105,5 @@ class Rectangle : public RenderObject {
 
     Vec3 normal_;
 
-    std::shared_ptr<Material> mat_;
+    MaterialId mat_ = 0;
 };
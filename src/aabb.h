@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <utility>
+
+#include "interval.h"
+#include "ray.h"
+#include "raytracer.h"
+#include "vec3.h"
+
+// axis-aligned bounding box
+class AABB {
+   public:
+    static const AABB kEmpty;
+
+    constexpr AABB() = default;
+    constexpr AABB(Point3 min, Point3 max) : min_{min}, max_{max} {}
+
+    constexpr Point3 min() const { return min_; }
+    constexpr Point3 max() const { return max_; }
+
+    constexpr bool empty() const {
+        return min_.x() > max_.x() || min_.y() > max_.y() || min_.z() > max_.z();
+    }
+
+    constexpr Point3 centroid() const { return 0.5 * (min_ + max_); }
+
+    constexpr Vec3 extent() const { return max_ - min_; }
+
+    constexpr f64 SurfaceArea() const {
+        if (empty()) {
+            return 0.0;
+        }
+
+        Vec3 d = extent();
+        return 2.0 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+    }
+
+    // index of the axis along which the box is longest
+    constexpr u32 LongestAxis() const {
+        Vec3 d = extent();
+
+        if (d.x() >= d.y() && d.x() >= d.z()) {
+            return 0;
+        }
+
+        return d.y() >= d.z() ? 1 : 2;
+    }
+
+    constexpr AABB& Extend(Point3 p) {
+        min_ = Point3{std::min(min_.x(), p.x()), std::min(min_.y(), p.y()),
+                      std::min(min_.z(), p.z())};
+        max_ = Point3{std::max(max_.x(), p.x()), std::max(max_.y(), p.y()),
+                      std::max(max_.z(), p.z())};
+
+        return *this;
+    }
+
+    constexpr AABB& Extend(const AABB& other) {
+        if (other.empty()) {
+            return *this;
+        }
+
+        Extend(other.min_);
+        Extend(other.max_);
+
+        return *this;
+    }
+
+    // grow the box by `delta` on every side, used to give flat shapes some thickness
+    constexpr AABB Padded(f64 delta) const {
+        Vec3 d{delta, delta, delta};
+        return AABB{min_ - d, max_ + d};
+    }
+
+    // slab test: return the entry t of the ray into the box, or kInf if the ray misses the box
+    // inside `ts`. `inv_dir` is the componentwise inverse of the ray direction.
+    //
+    // the exit t is scaled up by the worst case rounding error of its computation (Ize, "Robust
+    // BVH Ray Traversal", JCGT 2013), so rays through a corner or an edge of the box, e.g. aimed
+    // at a mesh vertex, are never lost to rounding.
+    constexpr f64 Hit(const Ray& ray, Vec3 inv_dir, Interval ts) const {
+        Point3 orig = ray.origin();
+
+        f64 t_enter = ts.min();
+        f64 t_exit = ts.max();
+
+        for (u32 axis = 0; axis < 3; axis++) {
+            f64 t0 = (min_[axis] - orig[axis]) * inv_dir[axis];
+            f64 t1 = (max_[axis] - orig[axis]) * inv_dir[axis];
+
+            if (t0 > t1) {
+                std::swap(t0, t1);
+            }
+
+            t1 *= kExitScale;
+
+            t_enter = std::max(t_enter, t0);
+            t_exit = std::min(t_exit, t1);
+
+            if (t_enter > t_exit) {
+                return kInf;
+            }
+        }
+
+        return t_enter;
+    }
+
+   private:
+    // 1 + 2 gamma(3), gamma(n) = n u / (1 - n u) with the unit roundoff u
+    static constexpr f64 kExitScale = [] {
+        constexpr f64 u = std::numeric_limits<f64>::epsilon() / 2;
+        constexpr f64 gamma3 = 3 * u / (1 - 3 * u);
+
+        return 1 + 2 * gamma3;
+    }();
+
+    Point3 min_{kInf, kInf, kInf};
+    Point3 max_{-kInf, -kInf, -kInf};
+};
+
+constexpr AABB AABB::kEmpty{};
+
+constexpr AABB Union(AABB a, const AABB& b) {
+    a.Extend(b);
+    return a;
+}
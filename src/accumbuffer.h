@@ -0,0 +1,298 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+
+#include "colour.h"
+#include "image.h"
+#include "raytracer.h"
+
+// 64-bit FNV-1a of everything added, to tell apart renders that would draw different samples
+class Fingerprint {
+   public:
+    constexpr Fingerprint& Add(std::span<const std::byte> bytes) {
+        for (std::byte b : bytes) {
+            hash_ = (hash_ ^ static_cast<u64>(b)) * kPrime;
+        }
+
+        return *this;
+    }
+
+    template <typename T>
+        requires std::is_arithmetic_v<T>
+    constexpr Fingerprint& Add(T value) {
+        auto bytes = std::bit_cast<std::array<std::byte, sizeof(T)>>(value);
+
+        return Add(std::span<const std::byte>{bytes});
+    }
+
+    template <typename T>
+        requires std::is_arithmetic_v<T>
+    Fingerprint& Add(std::span<const T> values) {
+        return Add(std::as_bytes(values));
+    }
+
+    Fingerprint& Add(std::string_view str) {
+        // the length keeps "ab" + "c" and "a" + "bc" apart
+        Add(str.size());
+
+        return Add(std::as_bytes(std::span{str}));
+    }
+
+    constexpr u64 value() const { return hash_; }
+
+   private:
+    static constexpr u64 kPrime = 0x100000001b3;
+
+    u64 hash_ = 0xcbf29ce484222325;
+};
+
+// what a checkpoint must have been rendered with to be resumed: the same image size, pass size
+// and seed, and the same scene and settings, summed up in `settings`
+struct CheckpointKey {
+    u32 width = 0;
+    u32 height = 0;
+
+    u32 pass_samples = 0;
+    u64 seed = 0;
+
+    u64 settings = 0;  // `Fingerprint` of the scene and everything else the samples depend on
+};
+
+// thrown when a checkpoint is of another render than the one asked for
+class CheckpointMismatch : public std::runtime_error {
+   public:
+    using std::runtime_error::runtime_error;
+};
+
+// per-pixel colour sums and sample counts of a progressive render, kept in a memory-mapped file
+//
+// the file doubles as the checkpoint: `Checkpoint` flushes it to disk, and opening the file for
+// a render with the same `CheckpointKey` resumes from whatever it contains. Every pixel records
+// its own sample count, so a render killed in the middle of a pass loses at most the pixels
+// being worked on.
+class AccumulationBuffer {
+   public:
+    struct Pixel {
+        Colour sum;
+        u32 samples = 0;
+        u32 reserved = 0;
+    };
+
+    static_assert(std::is_trivially_copyable_v<Pixel>);
+    static_assert(sizeof(Pixel) == 32);
+
+    // open the checkpoint at `path`, creating it if it doesn't exist or is empty. Files that
+    // aren't checkpoints are never touched. A checkpoint of a render with another key is only
+    // started over if `overwrite` is set, otherwise opening fails.
+    AccumulationBuffer(const std::string& path, const CheckpointKey& key, bool overwrite = false)
+        : key_{key} {
+        fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+
+        if (fd_ < 0) {
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+        }
+
+        auto fail = [this, &path](const char* what) {
+            int err = errno;
+            close(fd_);
+            throw std::system_error(err, std::generic_category(), what + (' ' + path));
+        };
+
+        size_ = kPixelsOffset + sizeof(Pixel) * std::size_t{key_.width} * key_.height;
+
+        struct stat st {};
+
+        if (fstat(fd_, &st) < 0) {
+            fail("stat");
+        }
+
+        if (st.st_size > 0) {
+            Header on_disk{};
+
+            if (static_cast<std::size_t>(st.st_size) < sizeof(on_disk) ||
+                pread(fd_, &on_disk, sizeof(on_disk), 0) != sizeof(on_disk) ||
+                on_disk.magic != kMagic) {
+                close(fd_);
+                throw std::runtime_error(path + ": not a checkpoint, refusing to overwrite it");
+            }
+
+            const char* mismatch = Mismatch(on_disk, static_cast<std::size_t>(st.st_size));
+
+            if (mismatch == nullptr) {
+                resumed_ = true;
+            } else if (!overwrite) {
+                close(fd_);
+                throw CheckpointMismatch(path + ": checkpoint of another render (" + mismatch +
+                                         " differs)");
+            }
+        }
+
+        // start from scratch: truncating first makes sure all pixels read as zero
+        if (!resumed_ && (ftruncate(fd_, 0) < 0 || ftruncate(fd_, static_cast<off_t>(size_)) < 0)) {
+            fail("truncate");
+        }
+
+        void* data = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+
+        if (data == MAP_FAILED) {
+            fail("mmap");
+        }
+
+        data_ = static_cast<std::byte*>(data);
+
+        if (!resumed_) {
+            header() = Header{.magic = kMagic,
+                              .version = kVersion,
+                              .width = key_.width,
+                              .height = key_.height,
+                              .passes_done = 0,
+                              .pass_samples = key_.pass_samples,
+                              .seed = key_.seed,
+                              .settings = key_.settings};
+        }
+    }
+
+    AccumulationBuffer(const AccumulationBuffer&) = delete;
+    AccumulationBuffer& operator=(const AccumulationBuffer&) = delete;
+
+    AccumulationBuffer(AccumulationBuffer&&) = delete;
+    AccumulationBuffer& operator=(AccumulationBuffer&&) = delete;
+
+    ~AccumulationBuffer() {
+        msync(data_, size_, MS_SYNC);
+
+        munmap(data_, size_);
+        close(fd_);
+    }
+
+    constexpr u32 width() const { return key_.width; }
+    constexpr u32 height() const { return key_.height; }
+
+    constexpr const CheckpointKey& key() const { return key_; }
+
+    // whether the buffer was picked up from an earlier run
+    constexpr bool resumed() const { return resumed_; }
+
+    // number of passes that completed for every pixel
+    u32 passes_done() const { return header().passes_done; }
+    void passes_done(u32 passes) { header().passes_done = passes; }
+
+    Pixel& operator[](u32 x, u32 y) {
+        assert(x < width());
+        assert(y < height());
+
+        return pixels()[y * width() + x];
+    }
+
+    const Pixel& operator[](u32 x, u32 y) const {
+        assert(x < width());
+        assert(y < height());
+
+        return pixels()[y * width() + x];
+    }
+
+    // block until everything accumulated so far is on disk
+    void Checkpoint() {
+        if (msync(data_, size_, MS_SYNC) < 0) {
+            throw std::system_error(errno, std::generic_category(), "msync");
+        }
+    }
+
+    // average of the samples so far
+    Image Resolve() const {
+        Image img{width(), height()};
+
+        for (u32 j = 0; j < height(); j++) {
+            for (u32 i = 0; i < width(); i++) {
+                const Pixel& px = (*this)[i, j];
+
+                img[i, j] = px.samples > 0 ? px.sum / px.samples : Colour::kBlack;
+            }
+        }
+
+        return img;
+    }
+
+   private:
+    static constexpr std::array<char, 8> kMagic{'R', 'T', 'A', 'C', 'C', 'U', 'M', '\0'};
+    static constexpr u32 kVersion = 2;
+
+    struct Header {
+        std::array<char, 8> magic;
+        u32 version;
+
+        u32 width;
+        u32 height;
+
+        u32 passes_done;
+
+        u32 pass_samples;
+        u64 seed;
+        u64 settings;
+    };
+
+    static constexpr std::size_t kPixelsOffset = 64;
+
+    static_assert(sizeof(Header) <= kPixelsOffset);
+
+    // the first field of `on_disk` (of a file of `file_size` bytes) that doesn't match our key,
+    // nullptr if it can be resumed
+    const char* Mismatch(const Header& on_disk, std::size_t file_size) const {
+        if (on_disk.version != kVersion) {
+            return "format version";
+        }
+
+        if (on_disk.width != key_.width || on_disk.height != key_.height) {
+            return "image size";
+        }
+
+        if (on_disk.pass_samples != key_.pass_samples) {
+            return "samples per pass";
+        }
+
+        if (on_disk.seed != key_.seed) {
+            return "seed";
+        }
+
+        if (on_disk.settings != key_.settings) {
+            return "scene or settings";
+        }
+
+        if (file_size != size_) {
+            return "file size";
+        }
+
+        return nullptr;
+    }
+
+    Header& header() { return *reinterpret_cast<Header*>(data_); }
+    const Header& header() const { return *reinterpret_cast<const Header*>(data_); }
+
+    Pixel* pixels() { return reinterpret_cast<Pixel*>(data_ + kPixelsOffset); }
+    const Pixel* pixels() const { return reinterpret_cast<const Pixel*>(data_ + kPixelsOffset); }
+
+    CheckpointKey key_;
+
+    int fd_ = -1;
+
+    std::byte* data_ = nullptr;
+    std::size_t size_ = 0;
+
+    bool resumed_ = false;
+};
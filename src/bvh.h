@@ -0,0 +1,554 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "aabb.h"
+#include "interval.h"
+#include "ray.h"
+#include "raytracer.h"
+#include "renderobject.h"
+#include "renderstats.h"
+#include "renderobjectlist.h"
+#include "threadpool.h"
+#include "vec3.h"
+
+enum class BVHSplitMethod {
+    kMedian,  // split at the centroid median along the longest axis
+    kSAH,     // binned surface area heuristic over all three axes
+};
+
+struct BVHBuildOptions {
+    BVHSplitMethod split_method = BVHSplitMethod::kSAH;
+
+    // run large subtrees as tasks on this pool, build on the calling thread only if null
+    ThreadPool* pool = nullptr;
+};
+
+struct BVHBuildStats {
+    std::chrono::nanoseconds duration{};
+
+    u32 num_nodes = 0;
+    u32 num_leaves = 0;
+    u32 max_depth = 0;
+
+    // expected cost of a ray that hits the root box, relative to one object intersection
+    f64 sah_cost = 0.0;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const BVHBuildStats& stats) {
+    auto ms = std::chrono::duration<f64, std::milli>(stats.duration).count();
+
+    return os << "BVH: " << stats.num_nodes << " nodes, " << stats.num_leaves << " leaves, depth "
+              << stats.max_depth << ", SAH cost " << stats.sah_cost << ", built in " << ms
+              << " ms";
+}
+
+// bounding volume hierarchy over abstract primitives, known only by their bounds
+//
+// nodes are stored flattened, siblings are always adjacent: an interior node's children are at
+// `offset` and `offset + 1`. Leaves reference `count` primitives starting at position `offset`
+// of the leaf order, so owners store their primitives in that order and test ranges of them.
+class BVHTree {
+   public:
+    static constexpr u32 kMaxLeafSize = 4;
+
+    BVHTree() = default;
+
+    // build over primitives with bounds `prim_bounds`, filling `order` with the primitive indices
+    // in leaf order
+    BVHTree(std::span<const AABB> prim_bounds, std::vector<u32>& order,
+            BVHBuildOptions options = {}) {
+        auto start = std::chrono::steady_clock::now();
+
+        order.clear();
+
+        if (prim_bounds.empty()) {
+            return;
+        }
+
+        std::vector<BuildPrim> prims(prim_bounds.size());
+
+        for (u32 i = 0; i < prims.size(); i++) {
+            prims[i] = BuildPrim{prim_bounds[i], prim_bounds[i].centroid(), i};
+        }
+
+        Builder builder{options, nodes_};
+
+        // a binary tree with n leaves has 2n - 1 nodes, and we never have more leaves than
+        // primitives
+        nodes_.resize(2 * prims.size() - 1);
+        builder.Build(prims, 0, 0, 0);
+
+        nodes_.resize(builder.num_nodes());
+        nodes_.shrink_to_fit();
+
+        order.reserve(prims.size());
+
+        for (const auto& prim : prims) {
+            order.push_back(prim.index);
+        }
+
+        CollectStats();
+
+        stats_.duration = std::chrono::steady_clock::now() - start;
+    }
+
+    bool empty() const { return nodes_.empty(); }
+
+    AABB bounds() const { return nodes_.empty() ? AABB::kEmpty : nodes_[0].bounds; }
+
+    const BVHBuildStats& build_stats() const { return stats_; }
+
+    // visit the leaves the ray passes through, nearest first. `hit_leaf(first, count, ts)` tests
+    // the primitives at leaf positions [first, first + count) and returns the t of the closest
+    // hit inside `ts`, or `ts.max()` if there is none; later leaves are only searched in front
+    // of that.
+    template <typename F>
+    void Traverse(const Ray& ray, Interval ts, F&& hit_leaf) const {
+        if (nodes_.empty()) {
+            return;
+        }
+
+        Vec3 dir = ray.direction();
+        Vec3 inv_dir{1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z()};
+
+        f64 closest_t = ts.max();
+
+        std::array<u32, kMaxDepth> stack;  // NOLINT(cppcoreguidelines-pro-type-member-init)
+        u32 stack_size = 0;
+
+        IntersectionCounters::Count(PrimitiveKind::kBox);
+
+        if (nodes_[0].bounds.Hit(ray, inv_dir, ts) == kInf) {
+            return;
+        }
+
+        stack[stack_size++] = 0;
+
+        while (stack_size > 0) {
+            const Node& node = nodes_[stack[--stack_size]];
+
+            if (node.count > 0) {
+                // leaf
+
+                f64 t = hit_leaf(node.offset, node.count, Interval{ts.min(), closest_t});
+
+                closest_t = std::min(closest_t, t);
+
+                continue;
+            }
+
+            // interior: push the farther child first so the nearer one is visited first
+
+            u32 left = node.offset;
+            u32 right = node.offset + 1;
+
+            Interval _ts{ts.min(), closest_t};
+
+            IntersectionCounters::Count(PrimitiveKind::kBox, 2);
+
+            f64 t_left = nodes_[left].bounds.Hit(ray, inv_dir, _ts);
+            f64 t_right = nodes_[right].bounds.Hit(ray, inv_dir, _ts);
+
+            if (t_left > t_right) {
+                std::swap(left, right);
+                std::swap(t_left, t_right);
+            }
+
+            assert(stack_size + 2 <= kMaxDepth);
+
+            if (t_right != kInf) {
+                stack[stack_size++] = right;
+            }
+
+            if (t_left != kInf) {
+                stack[stack_size++] = left;
+            }
+        }
+    }
+
+    // visit the leaves the ray passes through, in no particular order, until
+    // `occluded_leaf(first, count, ts)` finds a hit among the primitives at leaf positions
+    // [first, first + count) and returns true. Returns whether one did.
+    template <typename F>
+    bool TraverseAny(const Ray& ray, Interval ts, F&& occluded_leaf) const {
+        if (nodes_.empty()) {
+            return false;
+        }
+
+        Vec3 dir = ray.direction();
+        Vec3 inv_dir{1.0 / dir.x(), 1.0 / dir.y(), 1.0 / dir.z()};
+
+        std::array<u32, kMaxDepth> stack;  // NOLINT(cppcoreguidelines-pro-type-member-init)
+        u32 stack_size = 0;
+
+        IntersectionCounters::Count(PrimitiveKind::kBox);
+
+        if (nodes_[0].bounds.Hit(ray, inv_dir, ts) == kInf) {
+            return false;
+        }
+
+        stack[stack_size++] = 0;
+
+        while (stack_size > 0) {
+            const Node& node = nodes_[stack[--stack_size]];
+
+            if (node.count > 0) {
+                if (occluded_leaf(node.offset, node.count, ts)) {
+                    return true;
+                }
+
+                continue;
+            }
+
+            // any hit will do, so there is no point in sorting the children
+            IntersectionCounters::Count(PrimitiveKind::kBox, 2);
+
+            assert(stack_size + 2 <= kMaxDepth);
+
+            if (nodes_[node.offset + 1].bounds.Hit(ray, inv_dir, ts) != kInf) {
+                stack[stack_size++] = node.offset + 1;
+            }
+
+            if (nodes_[node.offset].bounds.Hit(ray, inv_dir, ts) != kInf) {
+                stack[stack_size++] = node.offset;
+            }
+        }
+
+        return false;
+    }
+
+   private:
+    static constexpr u32 kMaxDepth = 64;
+
+    static constexpr u32 kNumBins = 16;
+
+    // SAH cost of visiting an interior node, relative to intersecting one primitive
+    static constexpr f64 kTraversalCost = 0.125;
+
+    // subtrees with fewer primitives are built on the current thread
+    static constexpr std::size_t kParallelThreshold = 4096;
+
+    struct Node {
+        AABB bounds;
+
+        u32 offset = 0;  // first leaf position for leaves, left child for interior nodes
+        u32 count = 0;   // number of primitives in a leaf, 0 for interior nodes
+    };
+
+    struct BuildPrim {
+        AABB bounds;
+        Point3 centroid;
+        u32 index = 0;
+    };
+
+    struct Bin {
+        AABB bounds;
+        u32 count = 0;
+    };
+
+    // state shared by the (possibly parallel) recursive build
+    class Builder {
+       public:
+        Builder(BVHBuildOptions options, std::vector<Node>& nodes)
+            : options_{options}, nodes_{nodes} {}
+
+        u32 num_nodes() const { return next_node_.load(); }
+
+        // build the subtree over `prims` into the (already allocated) node `node_idx`. `prims`
+        // is reordered in place, so that after building the whole tree it lists the primitives
+        // in leaf order; `first` is the position of `prims` in that list.
+        void Build(std::span<BuildPrim> prims, u32 first, u32 node_idx, u32 depth) {
+            AABB box;
+            AABB centroid_box;
+
+            for (const auto& prim : prims) {
+                box.Extend(prim.bounds);
+                centroid_box.Extend(prim.centroid);
+            }
+
+            nodes_[node_idx].bounds = box;
+
+            auto make_leaf = [&] {
+                nodes_[node_idx].offset = first;
+                nodes_[node_idx].count = static_cast<u32>(prims.size());
+            };
+
+            // stop on single primitives, when the stack limit is reached and when all centroids
+            // coincide, since then no split can separate them
+            u32 axis = centroid_box.LongestAxis();
+
+            if (prims.size() == 1 || depth + 2 >= kMaxDepth ||
+                centroid_box.extent()[axis] <= 0.0) {
+                make_leaf();
+                return;
+            }
+
+            std::size_t mid = 0;
+
+            switch (options_.split_method) {
+                case BVHSplitMethod::kMedian:
+                    if (prims.size() <= kMaxLeafSize) {
+                        make_leaf();
+                        return;
+                    }
+
+                    mid = SplitMedian(prims, axis);
+                    break;
+
+                case BVHSplitMethod::kSAH: {
+                    auto split = SplitSAH(prims, box, centroid_box);
+
+                    if (!split.has_value()) {
+                        make_leaf();
+                        return;
+                    }
+
+                    mid = split.value();
+                    break;
+                }
+            }
+
+            assert(0 < mid && mid < prims.size());
+
+            u32 left = next_node_.fetch_add(2);
+            nodes_[node_idx].offset = left;
+
+            auto build_left = [this, prims, first, left, depth, mid] {
+                Build(prims.first(mid), first, left, depth + 1);
+            };
+
+            auto build_right = [this, prims, first, left, depth, mid] {
+                Build(prims.subspan(mid), first + static_cast<u32>(mid), left + 1, depth + 1);
+            };
+
+            if (options_.pool != nullptr && prims.size() >= kParallelThreshold) {
+                ThreadPool::TaskGroup group;
+
+                options_.pool->Submit(group, build_left);
+                build_right();
+
+                options_.pool->Wait(group);
+            } else {
+                build_left();
+                build_right();
+            }
+        }
+
+       private:
+        BVHBuildOptions options_;
+
+        std::vector<Node>& nodes_;
+        std::atomic_uint32_t next_node_ = 1;
+    };
+
+    static std::size_t SplitMedian(std::span<BuildPrim> prims, u32 axis) {
+        auto mid = prims.size() / 2;
+
+        std::nth_element(prims.begin(), prims.begin() + static_cast<std::ptrdiff_t>(mid),
+                         prims.end(), [axis](const BuildPrim& a, const BuildPrim& b) {
+                             return a.centroid[axis] < b.centroid[axis];
+                         });
+
+        return mid;
+    }
+
+    // partition `prims` at the cheapest binned SAH split and return the size of the left part,
+    // or nullopt if a leaf is cheaper
+    static std::optional<std::size_t> SplitSAH(std::span<BuildPrim> prims, const AABB& box,
+                                               const AABB& centroid_box) {
+        f64 best_cost = kInf;
+        u32 best_axis = 0;
+        u32 best_split = 0;
+
+        auto bin_index = [&centroid_box](const BuildPrim& prim, u32 axis) {
+            f64 lo = centroid_box.min()[axis];
+            f64 extent = centroid_box.extent()[axis];
+
+            auto b = static_cast<u32>(kNumBins * (prim.centroid[axis] - lo) / extent);
+
+            return std::min(b, kNumBins - 1);
+        };
+
+        for (u32 axis = 0; axis < 3; axis++) {
+            if (centroid_box.extent()[axis] <= 0.0) {
+                continue;
+            }
+
+            std::array<Bin, kNumBins> bins{};
+
+            for (const auto& prim : prims) {
+                Bin& bin = bins[bin_index(prim, axis)];
+
+                bin.bounds.Extend(prim.bounds);
+                bin.count++;
+            }
+
+            // sweep from the right to get the cost of everything right of each split plane
+            std::array<f64, kNumBins> right_cost{};
+
+            AABB right_box;
+            u32 right_count = 0;
+
+            for (u32 i = kNumBins - 1; i > 0; i--) {
+                right_box.Extend(bins[i].bounds);
+                right_count += bins[i].count;
+
+                right_cost[i] = right_count * right_box.SurfaceArea();
+            }
+
+            // then from the left, splitting between bin i - 1 and bin i
+
+            AABB left_box;
+            u32 left_count = 0;
+
+            for (u32 i = 1; i < kNumBins; i++) {
+                left_box.Extend(bins[i - 1].bounds);
+                left_count += bins[i - 1].count;
+
+                if (left_count == 0 || left_count == prims.size()) {
+                    continue;
+                }
+
+                f64 cost = left_count * left_box.SurfaceArea() + right_cost[i];
+
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = i;
+                }
+            }
+        }
+
+        if (best_cost == kInf) {
+            return std::nullopt;
+        }
+
+        best_cost = kTraversalCost + best_cost / box.SurfaceArea();
+
+        f64 leaf_cost = static_cast<f64>(prims.size());
+
+        if (prims.size() <= kMaxLeafSize && leaf_cost <= best_cost) {
+            return std::nullopt;
+        }
+
+        auto mid = std::partition(prims.begin(), prims.end(), [&](const BuildPrim& prim) {
+            return bin_index(prim, best_axis) < best_split;
+        });
+
+        return static_cast<std::size_t>(mid - prims.begin());
+    }
+
+    void CollectStats() {
+        stats_.num_nodes = static_cast<u32>(nodes_.size());
+
+        f64 root_area = nodes_[0].bounds.SurfaceArea();
+
+        std::vector<std::pair<u32, u32>> stack{{0, 0}};
+
+        while (!stack.empty()) {
+            auto [node_idx, depth] = stack.back();
+            stack.pop_back();
+
+            const Node& node = nodes_[node_idx];
+
+            stats_.max_depth = std::max(stats_.max_depth, depth);
+
+            f64 rel_area = root_area > 0.0 ? node.bounds.SurfaceArea() / root_area : 1.0;
+
+            if (node.count > 0) {
+                stats_.num_leaves++;
+                stats_.sah_cost += rel_area * node.count;
+            } else {
+                stats_.sah_cost += rel_area * kTraversalCost;
+
+                stack.emplace_back(node.offset, depth + 1);
+                stack.emplace_back(node.offset + 1, depth + 1);
+            }
+        }
+    }
+
+    BVHBuildStats stats_;
+
+    std::vector<Node> nodes_;
+};
+
+// bounding volume hierarchy over a set of render objects
+class BVH : public RenderObject {
+   public:
+    static constexpr u32 kMaxLeafSize = BVHTree::kMaxLeafSize;
+
+    // takes ownership of all objects in `list`
+    explicit BVH(RenderObjectList&& list, BVHBuildOptions options = {}) : list_{std::move(list)} {
+        std::vector<AABB> bounds;
+        bounds.reserve(list_.size());
+
+        for (const auto* obj : list_) {
+            bounds.push_back(obj->bounds());
+        }
+
+        std::vector<u32> order;
+        tree_ = BVHTree{bounds, order, options};
+
+        // reference the objects in leaf order, so every leaf references a contiguous range
+        objs_.reserve(order.size());
+
+        for (u32 i : order) {
+            objs_.push_back(&list_[i]);
+        }
+    }
+
+    bool intersect(const Ray& ray, Interval ts, Intersection& isect) const override {
+        bool found = false;
+
+        tree_.Traverse(ray, ts, [&](u32 first, u32 count, Interval leaf_ts) {
+            f64 closest_t = leaf_ts.max();
+
+            for (u32 i = first; i < first + count; i++) {
+                if (objs_[i]->intersect(ray, Interval{leaf_ts.min(), closest_t}, isect)) {
+                    found = true;
+                    closest_t = isect.t;
+                }
+            }
+
+            return closest_t;
+        });
+
+        return found;
+    }
+
+    bool occluded(const Ray& ray, Interval ts) const override {
+        return tree_.TraverseAny(ray, ts, [&](u32 first, u32 count, Interval leaf_ts) {
+            for (u32 i = first; i < first + count; i++) {
+                if (objs_[i]->occluded(ray, leaf_ts)) {
+                    return true;
+                }
+            }
+
+            return false;
+        });
+    }
+
+    AABB bounds() const override { return tree_.bounds(); }
+
+    void AddLights(LightList& lights) const override {
+        list_.AddLights(lights);
+    }
+
+    const BVHBuildStats& build_stats() const { return tree_.build_stats(); }
+
+   private:
+    BVHTree tree_;
+
+    RenderObjectList list_;
+    std::vector<const RenderObject*> objs_;
+};
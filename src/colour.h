@@ -1,24 +1,34 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <concepts>
 #include <iomanip>
 #include <ios>
 #include <iostream>
 #include <ostream>
 #include <sstream>
 #include <string>
+#include <type_traits>
 
 #include "raytracer.h"
 #include "vec3.h"
 
-class Colour {
+template <std::floating_point T>
+class BasicColour {
    public:
-    static const Colour kBlack;
-    static const Colour kWhite;
+    using Scalar = T;
 
-    constexpr Colour() = default;
-    constexpr Colour(f64 r, f64 g, f64 b) : r_{r}, g_{g}, b_{b} {}
+    static const BasicColour kBlack;
+    static const BasicColour kWhite;
+
+    constexpr BasicColour() = default;
+    constexpr BasicColour(T r, T g, T b) : r_{r}, g_{g}, b_{b} {}
+
+    template <std::floating_point U>
+    constexpr explicit BasicColour(BasicColour<U> c)
+        : BasicColour{static_cast<T>(c.r()), static_cast<T>(c.g()), static_cast<T>(c.b())} {}
 
     constexpr void CheckValid() const {
         assert(0.0 <= r() && r() <= 1.0);
@@ -26,17 +36,17 @@ class Colour {
         assert(0.0 <= b() && b() <= 1.0);
     }
 
-    constexpr explicit Colour(Vec3 v) : Colour{v.x(), v.y(), v.z()} {}
+    constexpr explicit BasicColour(BasicVec3<T> v) : BasicColour{v.x(), v.y(), v.z()} {}
 
-    constexpr f64& r() { return r_; }
-    constexpr f64& g() { return g_; }
-    constexpr f64& b() { return b_; }
+    constexpr T& r() { return r_; }
+    constexpr T& g() { return g_; }
+    constexpr T& b() { return b_; }
 
-    constexpr f64 r() const { return r_; }
-    constexpr f64 g() const { return g_; }
-    constexpr f64 b() const { return b_; }
+    constexpr T r() const { return r_; }
+    constexpr T g() const { return g_; }
+    constexpr T b() const { return b_; }
 
-    constexpr Colour& operator+=(const Colour& c) {
+    constexpr BasicColour& operator+=(const BasicColour& c) {
         r_ += c.r();
         g_ += c.g();
         b_ += c.b();
@@ -44,7 +54,7 @@ class Colour {
         return *this;
     }
 
-    constexpr Colour& operator*=(const Colour& c) {
+    constexpr BasicColour& operator*=(const BasicColour& c) {
         r_ *= c.r();
         g_ *= c.g();
         b_ *= c.b();
@@ -52,8 +62,22 @@ class Colour {
         return *this;
     }
 
-    constexpr Colour to_gamma2() const {
-        return Colour{std::sqrt(r()), std::sqrt(g()), std::sqrt(b())};
+    // clamp all channels to [0, 1], e.g. before quantising to 8 bits
+    constexpr BasicColour clamped() const {
+        return BasicColour{std::clamp(r_, T{0}, T{1}), std::clamp(g_, T{0}, T{1}),
+                           std::clamp(b_, T{0}, T{1})};
+    }
+
+    constexpr T max_component() const { return std::max({r_, g_, b_}); }
+
+    // relative luminance of linear Rec. 709 primaries
+    constexpr T luminance() const {
+        return static_cast<T>(0.2126) * r_ + static_cast<T>(0.7152) * g_ +
+               static_cast<T>(0.0722) * b_;
+    }
+
+    constexpr BasicColour to_gamma2() const {
+        return BasicColour{std::sqrt(r()), std::sqrt(g()), std::sqrt(b())};
     }
 
     std::string to_string() const {
@@ -69,41 +93,52 @@ class Colour {
     }
 
    private:
-    f64 r_ = 0.0;
-    f64 g_ = 0.0;
-    f64 b_ = 0.0;
+    T r_ = 0;
+    T g_ = 0;
+    T b_ = 0;
 };
 
-constexpr Colour Colour::kBlack{0.0, 0.0, 0.0};
-constexpr Colour Colour::kWhite{1.0, 1.0, 1.0};
+template <std::floating_point T>
+constexpr BasicColour<T> BasicColour<T>::kBlack{0, 0, 0};
+template <std::floating_point T>
+constexpr BasicColour<T> BasicColour<T>::kWhite{1, 1, 1};
 
-constexpr Colour operator*(f64 t, Colour col) {
+using Colour = BasicColour<f64>;
+using Colourf = BasicColour<f32>;
+
+template <std::floating_point T>
+constexpr BasicColour<T> operator*(std::type_identity_t<T> t, BasicColour<T> col) {
     return {t * col.r(), t * col.g(), t * col.b()};
 }
-constexpr Colour operator/(Colour col, f64 t) {
-    return (1.0 / t) * col;
+
+template <std::floating_point T>
+constexpr BasicColour<T> operator/(BasicColour<T> col, std::type_identity_t<T> t) {
+    return (1 / t) * col;
 }
 
-constexpr Colour operator+(Colour c1, Colour c2) {
-    Colour out{c1};
+template <std::floating_point T>
+constexpr BasicColour<T> operator+(BasicColour<T> c1, BasicColour<T> c2) {
+    BasicColour<T> out{c1};
 
     out += c2;
 
     return out;
 }
 
-constexpr Colour operator*(Colour c1, Colour c2) {
-    Colour out{c1};
+template <std::floating_point T>
+constexpr BasicColour<T> operator*(BasicColour<T> c1, BasicColour<T> c2) {
+    BasicColour<T> out{c1};
 
     out *= c2;
 
     return out;
 }
 
-inline std::ostream& operator<<(std::ostream& os, Colour c) {
-    double r = c.r();
-    double g = c.g();
-    double b = c.b();
+template <std::floating_point T>
+std::ostream& operator<<(std::ostream& os, BasicColour<T> c) {
+    f64 r = c.r();
+    f64 g = c.g();
+    f64 b = c.b();
 
     os << FToU8(r) << ' ' << FToU8(g) << ' ' << FToU8(b);
 
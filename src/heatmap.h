@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "colour.h"
+#include "image.h"
+#include "raytracer.h"
+#include "renderstats.h"
+
+// cost heatmaps: instead of its colour, every pixel gets what it cost to render, to find the
+// objects and materials worth simplifying and to see whether the acceleration structure works
+
+enum class CostMetric : u32 {
+    kBoxTests,        // BVH node bounds tested, i.e. traversal steps
+    kPrimitiveTests,  // primitives tested
+    kBounces,         // scattering events along the paths
+    kTime,            // nanoseconds, including everything but the image write
+};
+
+constexpr u32 kNumCostMetrics = 4;
+
+constexpr std::array<std::string_view, kNumCostMetrics> kCostMetricNames{"boxes", "tests",
+                                                                          "bounces", "time"};
+
+constexpr std::string_view CostMetricName(CostMetric metric) {
+    return kCostMetricNames[static_cast<u32>(metric)];
+}
+
+constexpr std::optional<CostMetric> ParseCostMetric(std::string_view name) {
+    for (u32 m = 0; m < kNumCostMetrics; m++) {
+        if (kCostMetricNames[m] == name) {
+            return static_cast<CostMetric>(m);
+        }
+    }
+
+    return std::nullopt;
+}
+
+// running total of `metric` on the calling thread, whose stats are `stats`. The cost of a pixel is
+// the difference of the totals after and before it.
+inline u64 CostCounter(CostMetric metric, const RenderStats& stats) {
+    const auto& tests = IntersectionCounters::Local();
+
+    switch (metric) {
+        case CostMetric::kBoxTests:
+            return tests[static_cast<u32>(PrimitiveKind::kBox)];
+        case CostMetric::kPrimitiveTests: {
+            u64 total = 0;
+
+            for (u32 k = 0; k < kNumPrimitiveKinds; k++) {
+                auto kind = static_cast<PrimitiveKind>(k);
+
+                if (kind != PrimitiveKind::kBox && kind != PrimitiveKind::kInstance) {
+                    total += tests[k];
+                }
+            }
+
+            return total;
+        }
+        case CostMetric::kBounces:
+            // every path is one ray plus one per bounce
+            return stats.rays - stats.num_paths();
+        case CostMetric::kTime:
+            return static_cast<u64>(std::chrono::steady_clock::now().time_since_epoch() /
+                                    std::chrono::nanoseconds{1});
+    }
+
+    return 0;
+}
+
+// cost images keep the cost of pixel (i, j) in all three channels of img[i, j]
+
+// the cost that is mapped to the top of the colour scale: the `percentile` of the pixel costs,
+// so that a few outliers (e.g. a preempted pixel in a time heatmap) don't wash out the rest
+inline f64 CostScale(const Image& cost, f64 percentile = 0.99) {
+    assert(0.0 <= percentile && percentile <= 1.0);
+
+    std::vector<f64> values;
+    values.reserve(static_cast<std::size_t>(cost.width()) * cost.height());
+
+    for (u32 j = 0; j < cost.height(); j++) {
+        for (u32 i = 0; i < cost.width(); i++) {
+            values.push_back(cost[i, j].r());
+        }
+    }
+
+    if (values.empty()) {
+        return 0.0;
+    }
+
+    auto nth = values.begin() + static_cast<std::ptrdiff_t>(
+                                    percentile * static_cast<f64>(values.size() - 1));
+    std::ranges::nth_element(values, nth);
+
+    return *nth;
+}
+
+// false colour for `x` in [0, 1], from dark blue (cheap) through cyan, green and yellow to red
+// (expensive)
+constexpr Colour CostColour(f64 x) {
+    constexpr std::array<Colour, 6> kScale{
+        Colour{0.0, 0.0, 0.5}, Colour{0.0, 0.0, 1.0}, Colour{0.0, 1.0, 1.0},
+        Colour{0.0, 1.0, 0.0}, Colour{1.0, 1.0, 0.0}, Colour{1.0, 0.0, 0.0},
+    };
+
+    x = std::clamp(x, 0.0, 1.0) * static_cast<f64>(kScale.size() - 1);
+
+    auto k = std::min(static_cast<std::size_t>(x), kScale.size() - 2);
+    f64 f = x - static_cast<f64>(k);
+
+    return (1.0 - f) * kScale[k] + f * kScale[k + 1];
+}
+
+// map `cost` to false colour, with costs of `scale` and up at the top of the scale. The colours
+// are stored squared, so that the gamma 2 of the 8 bit formats gives back the scale.
+inline Image FalseColour(const Image& cost, f64 scale) {
+    Image img{cost.width(), cost.height()};
+
+    for (u32 j = 0; j < cost.height(); j++) {
+        for (u32 i = 0; i < cost.width(); i++) {
+            Colour col = CostColour(scale > 0.0 ? cost[i, j].r() / scale : 0.0);
+
+            img[i, j] = col * col;
+        }
+    }
+
+    return img;
+}
@@ -1,13 +1,21 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
 #include <cstddef>
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
 
 #include "colour.h"
 #include "raytracer.h"
+#include "threadpool.h"
 
 class Image {
    public:
@@ -53,9 +61,8 @@ constexpr std::ostream& operator<<(std::ostream& os, const Image& img) {
 
     for (u32 j = 0; j < img.height(); j++) {
         for (u32 i = 0; i < img.width(); i++) {
-            const Colour col = img[i, j];
-
-            col.CheckValid();
+            // samples are unbounded (e.g. after russian roulette), so clamp before quantising
+            const Colour col = img[i, j].clamped();
 
             // apply gamma 2 transform
             os << col.to_gamma2() << newline;
@@ -64,3 +71,156 @@ constexpr std::ostream& operator<<(std::ostream& os, const Image& img) {
 
     return os;
 }
+
+enum class ImageFormat {
+    kP3,   // ASCII PPM, 8 bit gamma 2
+    kP6,   // binary PPM, 8 bit gamma 2
+    kPFM,  // portable float map, linear 32 bit float
+};
+
+inline std::string ImageHeader(ImageFormat format, u32 width, u32 height) {
+    std::string size = std::to_string(width) + ' ' + std::to_string(height);
+
+    switch (format) {
+        case ImageFormat::kP3:
+            return "P3\n" + size + "\n255\n";
+        case ImageFormat::kP6:
+            return "P6\n" + size + "\n255\n";
+        case ImageFormat::kPFM:
+            // negative scale marks little endian data
+            return "PF\n" + size + '\n' +
+                   (std::endian::native == std::endian::little ? "-1.0" : "1.0") + '\n';
+    }
+
+    return {};
+}
+
+// bytes per pixel of the binary formats
+constexpr std::size_t EncodedPixelSize(ImageFormat format) {
+    assert(format == ImageFormat::kP6 || format == ImageFormat::kPFM);
+
+    return format == ImageFormat::kP6 ? 3 : 3 * sizeof(float);
+}
+
+// encode row `j` of `img` in binary format `format` to `out`
+inline void EncodeRow(ImageFormat format, const Image& img, u32 j, char* out) {
+    if (format == ImageFormat::kP6) {
+        for (u32 i = 0; i < img.width(); i++) {
+            const Colour col = img[i, j].clamped().to_gamma2();
+
+            *out++ = static_cast<char>(FToU8(col.r()));
+            *out++ = static_cast<char>(FToU8(col.g()));
+            *out++ = static_cast<char>(FToU8(col.b()));
+        }
+    } else {
+        for (u32 i = 0; i < img.width(); i++) {
+            const Colour col = img[i, j];
+
+            std::array<float, 3> rgb{static_cast<float>(col.r()), static_cast<float>(col.g()),
+                                     static_cast<float>(col.b())};
+
+            std::memcpy(out, rgb.data(), sizeof(rgb));
+            out += sizeof(rgb);
+        }
+    }
+}
+
+// encode `img` as binary PPM (P6) or PFM into one buffer, converting rows in parallel on `pool`
+inline std::vector<char> EncodeBinary(const Image& img, ImageFormat format, ThreadPool& pool) {
+    std::string header = ImageHeader(format, img.width(), img.height());
+
+    const std::size_t row_size = EncodedPixelSize(format) * img.width();
+
+    std::vector<char> buf(header.size() + row_size * img.height());
+
+    std::ranges::copy(header, buf.begin());
+
+    pool.ParallelFor(0, img.height(), [&](u32 j) {
+        // PFM stores rows bottom to top
+        u32 row = format == ImageFormat::kPFM ? img.height() - 1 - j : j;
+
+        EncodeRow(format, img, j, buf.data() + header.size() + row * row_size);
+    });
+
+    return buf;
+}
+
+// write `img` in `format`; the binary formats go out in a single write
+inline void WriteImage(std::ostream& os, const Image& img, ImageFormat format, ThreadPool& pool) {
+    if (format == ImageFormat::kP3) {
+        os << img;
+        return;
+    }
+
+    auto buf = EncodeBinary(img, format, pool);
+
+    os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+    os.flush();
+}
+
+// writes an image band by band, for renderers that never hold the whole frame in memory
+//
+// bands have to be passed in file order: top to bottom, except for PFM, which stores rows bottom
+// to top (see `bottom_up`). Each band is written with a single write.
+class ImageStreamWriter {
+   public:
+    ImageStreamWriter(std::ostream& os, ImageFormat format, u32 width, u32 height)
+        : os_{&os}, format_{format}, width_{width}, height_{height} {
+        std::string header = ImageHeader(format_, width_, height_);
+
+        os_->write(header.data(), static_cast<std::streamsize>(header.size()));
+    }
+
+    constexpr u32 width() const { return width_; }
+    constexpr u32 height() const { return height_; }
+
+    constexpr bool bottom_up() const { return format_ == ImageFormat::kPFM; }
+
+    // write the next band; `band` holds its rows in image order (top to bottom)
+    void WriteBand(const Image& band) {
+        assert(band.width() == width_);
+        assert(rows_written_ + band.height() <= height_);
+
+        if (format_ == ImageFormat::kP3) {
+            std::ostringstream ss;
+
+            for (u32 j = 0; j < band.height(); j++) {
+                for (u32 i = 0; i < band.width(); i++) {
+                    ss << band[i, j].clamped().to_gamma2() << newline;
+                }
+            }
+
+            buf_.assign(ss.view().begin(), ss.view().end());
+        } else {
+            const std::size_t row_size = EncodedPixelSize(format_) * width_;
+
+            buf_.resize(row_size * band.height());
+
+            for (u32 j = 0; j < band.height(); j++) {
+                u32 row = bottom_up() ? band.height() - 1 - j : j;
+
+                EncodeRow(format_, band, j, buf_.data() + row * row_size);
+            }
+        }
+
+        os_->write(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+
+        rows_written_ += band.height();
+
+        if (rows_written_ == height_) {
+            os_->flush();
+        }
+    }
+
+   private:
+    std::ostream* os_;
+
+    ImageFormat format_;
+
+    u32 width_;
+    u32 height_;
+
+    u32 rows_written_ = 0;
+
+    std::vector<char> buf_;
+};
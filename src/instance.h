@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cassert>
+#include <memory>
+#include <optional>
+#include <utility>
+
+#include "aabb.h"
+#include "interval.h"
+#include "ray.h"
+#include "raytracer.h"
+#include "renderobject.h"
+#include "renderstats.h"
+#include "transform.h"
+#include "vec3.h"
+
+// placed copy of shared geometry
+//
+// the geometry, typically a `BVH` or a `TriangleMesh` with its own acceleration structure, is
+// built once in its object space and shared by all instances, each of which only adds a
+// transform into world space. A `BVH` over the instances is the top level of a two-level
+// hierarchy: a million copies cost a million transforms, not a million copies of the geometry.
+class Instance : public RenderObject {
+   public:
+    Instance(std::shared_ptr<const RenderObject> geometry, const Transform& object_to_world)
+        : geometry_{std::move(geometry)},
+          world_to_object_{object_to_world.Inverse()},
+          bounds_{object_to_world.ApplyBounds(geometry_->bounds())} {
+        assert(geometry_ != nullptr);
+    }
+
+    const RenderObject& geometry() const { return *geometry_; }
+
+    // instances are one level of a two-level hierarchy, so `geometry` holds no instances itself
+    bool intersect(const Ray& ray, Interval ts, Intersection& isect) const override {
+        IntersectionCounters::Count(PrimitiveKind::kInstance);
+
+        // rays have unit directions, so the object space t differs from the world space one by
+        // the length of the transformed direction
+        Vec3 dir = world_to_object_.ApplyVector(ray.direction());
+        f64 scale = dir.norm();
+
+        Ray object_ray{world_to_object_.ApplyPoint(ray.origin()), dir};
+
+        if (!geometry_->intersect(object_ray, Interval{ts.min() * scale, ts.max() * scale},
+                                  isect)) {
+            return false;
+        }
+
+        assert(isect.instance == nullptr);
+
+        isect.t /= scale;
+        isect.instance = this;
+
+        return true;
+    }
+
+    HitRecord interaction(const Ray& ray, const Intersection& isect) const override {
+        Vec3 dir = world_to_object_.ApplyVector(ray.direction());
+        f64 scale = dir.norm();
+
+        Ray object_ray{world_to_object_.ApplyPoint(ray.origin()), dir};
+
+        Intersection object_isect = isect;
+        object_isect.t = isect.t * scale;
+        object_isect.instance = nullptr;
+
+        HitRecord hit_record = isect.obj->interaction(object_ray, object_isect);
+
+        hit_record.t = isect.t;
+        hit_record.p = ray.At(isect.t);
+
+        // normals transform with the inverse transpose, which keeps them on the side of the
+        // surface they were on
+        hit_record.normal = world_to_object_.ApplyTransposed(hit_record.normal).normed();
+
+        return hit_record;
+    }
+
+    bool occluded(const Ray& ray, Interval ts) const override {
+        IntersectionCounters::Count(PrimitiveKind::kInstance);
+
+        Vec3 dir = world_to_object_.ApplyVector(ray.direction());
+        f64 scale = dir.norm();
+
+        Ray object_ray{world_to_object_.ApplyPoint(ray.origin()), dir};
+
+        return geometry_->occluded(object_ray, Interval{ts.min() * scale, ts.max() * scale});
+    }
+
+    AABB bounds() const override { return bounds_; }
+
+   private:
+    std::shared_ptr<const RenderObject> geometry_;
+
+    // rays are taken into object space, the other direction is only needed for the bounds
+    Transform world_to_object_;
+
+    AABB bounds_;
+};
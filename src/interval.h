@@ -1,28 +1,41 @@
 #pragma once
 
 #include <algorithm>
+#include <concepts>
 
 #include "raytracer.h"
-class Interval {
+
+template <std::floating_point T>
+class BasicInterval {
    public:
-    static const Interval kEmpty, kFull, kPositive;
+    static const BasicInterval kEmpty, kFull, kPositive;
+
+    constexpr BasicInterval() = default;
+    constexpr BasicInterval(T min, T max) : min_{min}, max_{max} {}
 
-    constexpr Interval() = default;
-    constexpr Interval(f64 min, f64 max) : min_{min}, max_{max} {}
+    template <std::floating_point U>
+    constexpr explicit BasicInterval(BasicInterval<U> other)
+        : min_{static_cast<T>(other.min())}, max_{static_cast<T>(other.max())} {}
 
-    constexpr f64 min() const { return min_; }
-    constexpr f64 max() const { return max_; }
+    constexpr T min() const { return min_; }
+    constexpr T max() const { return max_; }
 
-    constexpr bool contains(f64 x) const { return min_ <= x && x <= max_; }
-    constexpr bool surronds(f64 x) const { return min_ < x && x < max_; }
+    constexpr bool contains(T x) const { return min_ <= x && x <= max_; }
+    constexpr bool surronds(T x) const { return min_ < x && x < max_; }
 
-    constexpr double clamp(f64 x) const { return std::clamp(x, min_, max_); }
+    constexpr T clamp(T x) const { return std::clamp(x, min_, max_); }
 
    private:
-    f64 min_ = kInf;
-    f64 max_ = -kInf;
+    T min_ = kInfOf<T>;
+    T max_ = -kInfOf<T>;
 };
 
-constexpr Interval Interval::kEmpty{kInf, -kInf};
-constexpr Interval Interval::kFull{-kInf, kInf};
-constexpr Interval Interval::kPositive{0.0, kInf};
+template <std::floating_point T>
+constexpr BasicInterval<T> BasicInterval<T>::kEmpty{kInfOf<T>, -kInfOf<T>};
+template <std::floating_point T>
+constexpr BasicInterval<T> BasicInterval<T>::kFull{-kInfOf<T>, kInfOf<T>};
+template <std::floating_point T>
+constexpr BasicInterval<T> BasicInterval<T>::kPositive{0, kInfOf<T>};
+
+using Interval = BasicInterval<f64>;
+using Intervalf = BasicInterval<f32>;
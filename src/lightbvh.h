@@ -0,0 +1,459 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "aabb.h"
+#include "raytracer.h"
+#include "vec3.h"
+
+// light hierarchy for picking the light to sample at a shading point in proportion to an estimate
+// of how much it contributes there, in O(log n) for n lights (Conty Estevez and Kulla 2018, as in
+// pbrt-v4)
+
+// bounds on a set of lights: where they are, how much they emit and in which directions
+struct LightBounds {
+    AABB bounds;
+
+    f64 phi = 0.0;  // emitted power
+
+    // all surface normals lie within theta_o of `w`, and light leaves a surface at most theta_e
+    // from its normal (pi / 2 for diffuse emitters). Two sided emitters count both normals.
+    Vec3 w{0, 0, 1};
+    f64 cos_theta_o = 1.0;
+    f64 cos_theta_e = 0.0;
+
+    bool two_sided = false;
+};
+
+// bounds of the lights of both `a` and `b`
+inline LightBounds Union(const LightBounds& a, const LightBounds& b) {
+    if (a.phi == 0.0) {
+        return b;
+    }
+
+    if (b.phi == 0.0) {
+        return a;
+    }
+
+    LightBounds u;
+
+    u.bounds = Union(a.bounds, b.bounds);
+    u.phi = a.phi + b.phi;
+    u.cos_theta_e = std::min(a.cos_theta_e, b.cos_theta_e);
+    u.two_sided = a.two_sided || b.two_sided;
+
+    // smallest cone around both normal cones
+    f64 theta_a = std::acos(std::clamp(a.cos_theta_o, -1.0, 1.0));
+    f64 theta_b = std::acos(std::clamp(b.cos_theta_o, -1.0, 1.0));
+    f64 theta_d = std::acos(std::clamp(dot(a.w, b.w), -1.0, 1.0));
+
+    if (std::min(theta_d + theta_b, kPi) <= theta_a) {
+        u.w = a.w;
+        u.cos_theta_o = a.cos_theta_o;
+    } else if (std::min(theta_d + theta_a, kPi) <= theta_b) {
+        u.w = b.w;
+        u.cos_theta_o = b.cos_theta_o;
+    } else {
+        f64 theta_o = (theta_a + theta_d + theta_b) / 2;
+        Vec3 axis = cross(a.w, b.w);
+
+        if (theta_o >= kPi || axis.squared() == 0.0) {
+            u.w = a.w;
+            u.cos_theta_o = -1.0;
+        } else {
+            // rotate a's axis towards b's by theta_o - theta_a (Rodrigues)
+            f64 theta_r = theta_o - theta_a;
+            Vec3 k = axis.normed();
+
+            u.w = (std::cos(theta_r) * a.w + std::sin(theta_r) * cross(k, a.w) +
+                   (1 - std::cos(theta_r)) * dot(k, a.w) * k)
+                      .normed();
+            u.cos_theta_o = std::cos(theta_o);
+        }
+    }
+
+    return u;
+}
+
+class LightBVH {
+   public:
+    LightBVH() = default;
+
+    // build over lights 0, 1, ... with the given bounds
+    explicit LightBVH(std::span<const LightBounds> lights) : trails_(lights.size()) {
+        if (lights.empty()) {
+            return;
+        }
+
+        std::vector<BuildLight> build;
+        build.reserve(lights.size());
+
+        for (u32 i = 0; i < lights.size(); i++) {
+            build.push_back(BuildLight{lights[i], lights[i].bounds.centroid(), i});
+        }
+
+        nodes_.reserve(2 * lights.size() - 1);
+
+        Build(build, 0, 0);
+    }
+
+    bool empty() const { return nodes_.empty(); }
+
+    // pick a light for the point `p` with normal `n` using the uniform `u`. Returns the light and
+    // the probability of picking it, nullopt if no light can reach `p`.
+    std::optional<std::pair<u32, f64>> Sample(Point3 p, Vec3 n, f64 u) const {
+        if (empty()) {
+            return std::nullopt;
+        }
+
+        u32 node = 0;
+        f64 pmf = 1.0;
+
+        for (;;) {
+            const Node& nd = nodes_[node];
+
+            if (nd.leaf()) {
+                if (node > 0 || nd.Importance(p, n) > 0.0) {
+                    return std::make_pair(nd.index(), pmf);
+                }
+
+                return std::nullopt;
+            }
+
+            f64 left = nodes_[node + 1].Importance(p, n);
+            f64 right = nodes_[nd.index()].Importance(p, n);
+
+            if (left == 0.0 && right == 0.0) {
+                return std::nullopt;
+            }
+
+            // descend, reusing `u` rescaled to the branch taken
+            f64 p_left = left / (left + right);
+
+            if (u < p_left) {
+                u = std::min(u / p_left, kOneMinusEpsilon);
+                pmf *= p_left;
+                node = node + 1;
+            } else {
+                u = std::min((u - p_left) / (1 - p_left), kOneMinusEpsilon);
+                pmf *= 1 - p_left;
+                node = nd.index();
+            }
+        }
+    }
+
+    // probability of `Sample` picking `light` for the point `p` with normal `n`
+    f64 Pmf(Point3 p, Vec3 n, u32 light) const {
+        assert(light < trails_.size());
+
+        u64 trail = trails_[light];
+
+        u32 node = 0;
+        f64 pmf = 1.0;
+
+        for (;;) {
+            const Node& nd = nodes_[node];
+
+            if (nd.leaf()) {
+                assert(nd.index() == light);
+
+                return node > 0 || nd.Importance(p, n) > 0.0 ? pmf : 0.0;
+            }
+
+            f64 left = nodes_[node + 1].Importance(p, n);
+            f64 right = nodes_[nd.index()].Importance(p, n);
+
+            if (left == 0.0 && right == 0.0) {
+                return 0.0;
+            }
+
+            if ((trail & 1) == 0) {
+                pmf *= left / (left + right);
+                node = node + 1;
+            } else {
+                pmf *= right / (left + right);
+                node = nd.index();
+            }
+
+            trail >>= 1;
+        }
+    }
+
+   private:
+    static constexpr f64 kOneMinusEpsilon = 1.0 - 0x1p-53;
+
+    // the path to a light is stored as one bit per level, which bounds the depth. Below
+    // `kMedianDepth` subtrees are split in half, so that any number of lights fits.
+    static constexpr u32 kMaxDepth = 64;
+    static constexpr u32 kMedianDepth = 32;
+
+    static constexpr u32 kNumBins = 12;
+
+    // what importance needs of the bounds of a subtree, precomputed
+    //
+    // interior nodes are followed by their first child, `index` is the second child; leaves
+    // hold the light `index`
+    class Node {
+       public:
+        Node() = default;
+
+        Node(const LightBounds& b, u32 index, bool leaf)
+            : centre_{b.bounds.centroid()},
+              r2_{b.bounds.extent().squared() / 4},
+              min_d2_{b.bounds.extent().norm() / 2},
+              phi_{b.phi},
+              w_{b.w},
+              cos_theta_o_{b.cos_theta_o},
+              sin_theta_o_{SafeSqrt(1 - b.cos_theta_o * b.cos_theta_o)},
+              cos_theta_e_{b.cos_theta_e},
+              index_{index},
+              two_sided_{b.two_sided},
+              leaf_{leaf} {}
+
+        u32 index() const { return index_; }
+        bool leaf() const { return leaf_; }
+
+        // conservative estimate of the light reaching `p` on a surface with normal `n`: the power
+        // over the squared distance, times bounds on the cosines at the lights and at `p`. It is 0
+        // only if none of the lights can reach `p`.
+        f64 Importance(Point3 p, Vec3 n) const {
+            Vec3 to_p = p - centre_;
+            f64 dist2 = to_p.squared();
+
+            Vec3 wi = dist2 > 0.0 ? to_p / std::sqrt(dist2) : w_;
+
+            // directions from `p` to anywhere in the bounds lie within theta_b of -wi
+            f64 cos_theta_b = -1.0;
+            f64 sin_theta_b = 0.0;
+
+            if (dist2 >= r2_) {
+                sin_theta_b = std::sqrt(r2_ / dist2);
+                cos_theta_b = SafeSqrt(1 - r2_ / dist2);
+            }
+
+            f64 cos_theta_w = dot(w_, wi);
+
+            if (two_sided_) {
+                cos_theta_w = std::abs(cos_theta_w);
+            }
+
+            f64 sin_theta_w = SafeSqrt(1 - cos_theta_w * cos_theta_w);
+
+            // smallest angle between `wi` and a normal, then between a direction to `p` and a
+            // normal
+            f64 cos_theta_x = CosSubClamped(sin_theta_w, cos_theta_w, sin_theta_o_, cos_theta_o_);
+            f64 sin_theta_x = SinSubClamped(sin_theta_w, cos_theta_w, sin_theta_o_, cos_theta_o_);
+
+            f64 cos_theta_p = CosSubClamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+
+            if (cos_theta_p <= cos_theta_e_) {
+                return 0.0;
+            }
+
+            // the distance to the centre means little to points close to the bounds
+            f64 importance = phi_ * cos_theta_p / std::max(dist2, min_d2_);
+
+            // and the smallest angle between the normal at `p` and a direction to the lights
+            f64 cos_theta_i = std::abs(dot(wi, n));
+            f64 sin_theta_i = SafeSqrt(1 - cos_theta_i * cos_theta_i);
+
+            importance *= CosSubClamped(sin_theta_i, cos_theta_i, sin_theta_b, cos_theta_b);
+
+            return std::max(importance, 0.0);
+        }
+
+       private:
+        Point3 centre_;
+        f64 r2_ = 0.0;      // squared radius of the bounding sphere
+        f64 min_d2_ = 0.0;  // lower bound on the squared distance used
+
+        f64 phi_ = 0.0;
+
+        Vec3 w_;
+        f64 cos_theta_o_ = 1.0;
+        f64 sin_theta_o_ = 0.0;
+        f64 cos_theta_e_ = 0.0;
+
+        u32 index_ = 0;
+        bool two_sided_ = false;
+        bool leaf_ = false;
+    };
+
+    static f64 SafeSqrt(f64 x) { return std::sqrt(std::max(0.0, x)); }
+
+    // cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b
+    static constexpr f64 CosSubClamped(f64 sin_a, f64 cos_a, f64 sin_b, f64 cos_b) {
+        return cos_a > cos_b ? 1.0 : cos_a * cos_b + sin_a * sin_b;
+    }
+
+    static constexpr f64 SinSubClamped(f64 sin_a, f64 cos_a, f64 sin_b, f64 cos_b) {
+        return cos_a > cos_b ? 0.0 : sin_a * cos_b - cos_a * sin_b;
+    }
+
+    struct BuildLight {
+        LightBounds bounds;
+        Point3 centroid;
+        u32 index = 0;
+    };
+
+    // build the subtree over `lights`, reached from the root by `trail`, and return its bounds
+    LightBounds Build(std::span<BuildLight> lights, u64 trail, u32 depth) {
+        assert(!lights.empty() && depth < kMaxDepth);
+
+        auto node = static_cast<u32>(nodes_.size());
+        nodes_.emplace_back();
+
+        if (lights.size() == 1) {
+            nodes_[node] = Node{lights[0].bounds, lights[0].index, true};
+            trails_[lights[0].index] = trail;
+
+            return lights[0].bounds;
+        }
+
+        auto mid = depth < kMedianDepth ? SplitSAOH(lights) : std::nullopt;
+
+        if (!mid.has_value()) {
+            mid = SplitMedian(lights);
+        }
+
+        LightBounds left = Build(lights.first(*mid), trail, depth + 1);
+
+        auto right_node = static_cast<u32>(nodes_.size());
+        LightBounds right = Build(lights.subspan(*mid), trail | (u64{1} << depth), depth + 1);
+
+        LightBounds bounds = Union(left, right);
+        nodes_[node] = Node{bounds, right_node, false};
+
+        return bounds;
+    }
+
+    // cost of a node bounding `b` by the surface area orientation heuristic: power times the
+    // solid angle the light is emitted into times the area, regularised against thin boxes
+    // across the split axis
+    static f64 Cost(const LightBounds& b, const AABB& node_bounds, u32 axis) {
+        f64 theta_o = std::acos(std::clamp(b.cos_theta_o, -1.0, 1.0));
+        f64 theta_e = std::acos(std::clamp(b.cos_theta_e, -1.0, 1.0));
+        f64 theta_w = std::min(theta_o + theta_e, kPi);
+        f64 sin_theta_o = std::sqrt(std::max(0.0, 1 - b.cos_theta_o * b.cos_theta_o));
+
+        f64 m_omega = 2 * kPi * (1 - b.cos_theta_o) +
+                      kPi / 2 *
+                          (2 * theta_w * sin_theta_o - std::cos(theta_o - 2 * theta_w) -
+                           2 * theta_o * sin_theta_o + b.cos_theta_o);
+
+        Vec3 extent = node_bounds.extent();
+        f64 kr = std::max({extent.x(), extent.y(), extent.z()}) / extent[axis];
+
+        return b.phi * m_omega * kr * b.bounds.SurfaceArea();
+    }
+
+    // partition `lights` at the cheapest binned split and return the size of the left part, or
+    // nullopt if there is none
+    static std::optional<std::size_t> SplitSAOH(std::span<BuildLight> lights) {
+        AABB box;
+        AABB centroid_box;
+
+        for (const auto& light : lights) {
+            box.Extend(light.bounds.bounds);
+            centroid_box.Extend(light.centroid);
+        }
+
+        f64 best_cost = kInf;
+        u32 best_axis = 0;
+        u32 best_split = 0;
+
+        auto bin_index = [&centroid_box](const BuildLight& light, u32 axis) {
+            f64 lo = centroid_box.min()[axis];
+            f64 extent = centroid_box.extent()[axis];
+
+            auto b = static_cast<u32>(kNumBins * (light.centroid[axis] - lo) / extent);
+
+            return std::min(b, kNumBins - 1);
+        };
+
+        for (u32 axis = 0; axis < 3; axis++) {
+            if (centroid_box.extent()[axis] <= 0.0) {
+                continue;
+            }
+
+            std::array<LightBounds, kNumBins> bins{};
+
+            for (const auto& light : lights) {
+                LightBounds& bin = bins[bin_index(light, axis)];
+                bin = Union(bin, light.bounds);
+            }
+
+            for (u32 i = 1; i < kNumBins; i++) {
+                LightBounds left;
+                LightBounds right;
+
+                for (u32 b = 0; b < i; b++) {
+                    left = Union(left, bins[b]);
+                }
+
+                for (u32 b = i; b < kNumBins; b++) {
+                    right = Union(right, bins[b]);
+                }
+
+                if (left.phi == 0.0 || right.phi == 0.0) {
+                    continue;
+                }
+
+                f64 cost = Cost(left, box, axis) + Cost(right, box, axis);
+
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = i;
+                }
+            }
+        }
+
+        if (best_cost == kInf) {
+            return std::nullopt;
+        }
+
+        auto mid = std::partition(lights.begin(), lights.end(), [&](const BuildLight& light) {
+            return bin_index(light, best_axis) < best_split;
+        });
+
+        auto left_size = static_cast<std::size_t>(mid - lights.begin());
+
+        if (left_size == 0 || left_size == lights.size()) {
+            return std::nullopt;
+        }
+
+        return left_size;
+    }
+
+    static std::size_t SplitMedian(std::span<BuildLight> lights) {
+        AABB centroid_box;
+
+        for (const auto& light : lights) {
+            centroid_box.Extend(light.centroid);
+        }
+
+        u32 axis = centroid_box.LongestAxis();
+        auto mid = lights.size() / 2;
+
+        std::nth_element(lights.begin(), lights.begin() + static_cast<std::ptrdiff_t>(mid),
+                         lights.end(), [axis](const BuildLight& a, const BuildLight& b) {
+                             return a.centroid[axis] < b.centroid[axis];
+                         });
+
+        return mid;
+    }
+
+    std::vector<Node> nodes_;
+
+    // the branches from the root to each light, bit d set if it is in the second child at depth d
+    std::vector<u64> trails_;
+};
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "aabb.h"
+#include "colour.h"
+#include "lightbvh.h"
+#include "material.h"
+#include "rand.h"
+#include "ray.h"
+#include "raytracer.h"
+#include "renderobject.h"
+#include "vec3.h"
+
+// area lights, sampled directly by the renderer (next event estimation)
+//
+// every `Sphere`, `Rectangle` and sphere of a `PackedSpheres` with a `DiffuseLight` material is a
+// light, found by `RenderObject::AddLights`. Other emitters, e.g. emissive triangle meshes or
+// instanced geometry, still shine when a path happens to hit them, but are never sampled.
+
+struct SphereShape {
+    Point3 centre;
+    f64 radius = 0.0;
+};
+
+// the parallelogram origin + s * a + t * b, s and t in [0, 1]
+struct RectangleShape {
+    Point3 origin;
+    Vec3 a;
+    Vec3 b;
+};
+
+// direction towards a light, sampled from a point in the scene
+struct LightSample {
+    Vec3 dir;  // unit vector
+    f64 dist = 0.0;
+
+    Colour emission;
+
+    f64 pdf = 0.0;  // solid angle density of `dir`
+};
+
+class Light {
+   public:
+    using Shape = std::variant<SphereShape, RectangleShape>;
+
+    constexpr Light(Shape shape, MaterialId mat, Colour emission)
+        : shape_{shape}, mat_{mat}, emission_{emission} {}
+
+    constexpr const Shape& shape() const { return shape_; }
+    constexpr MaterialId mat() const { return mat_; }
+    constexpr Colour emission() const { return emission_; }
+
+    constexpr f64 area() const {
+        if (const auto* sphere = std::get_if<SphereShape>(&shape_)) {
+            return 4 * kPi * sphere->radius * sphere->radius;
+        }
+
+        const auto& rect = std::get<RectangleShape>(shape_);
+
+        return cross(rect.a, rect.b).norm();
+    }
+
+    // where the light is, its power and the directions it emits into, for the `LightBVH`
+    LightBounds Bounds() const {
+        LightBounds b;
+
+        if (const auto* sphere = std::get_if<SphereShape>(&shape_)) {
+            Vec3 r{sphere->radius, sphere->radius, sphere->radius};
+
+            // normals point everywhere, only the outside is seen from outside
+            b.bounds = AABB{sphere->centre - r, sphere->centre + r};
+            b.phi = kPi * area() * emission_.luminance();
+            b.cos_theta_o = -1.0;
+
+            return b;
+        }
+
+        const auto& rect = std::get<RectangleShape>(shape_);
+
+        b.bounds.Extend(rect.origin);
+        b.bounds.Extend(rect.origin + rect.a);
+        b.bounds.Extend(rect.origin + rect.b);
+        b.bounds.Extend(rect.origin + rect.a + rect.b);
+
+        b.phi = 2 * kPi * area() * emission_.luminance();
+        b.w = cross(rect.a, rect.b).normed();
+        b.cos_theta_o = 1.0;
+        b.two_sided = true;
+
+        return b;
+    }
+
+    // sample a direction from `p` towards the light using the uniforms `u1` and `u2`. Spheres
+    // are sampled uniformly in the cone they subtend, rectangles uniformly by area.
+    std::optional<LightSample> Sample(Point3 p, f64 u1, f64 u2) const {
+        if (const auto* sphere = std::get_if<SphereShape>(&shape_)) {
+            if ((p - sphere->centre).squared() > sphere->radius * sphere->radius) {
+                return SampleCone(*sphere, p, u1, u2);
+            }
+
+            // inside, every direction hits it
+            Vec3 n = RandomGen::SphereFromUniforms(u1, u2);
+
+            return SampleArea(p, sphere->centre + sphere->radius * n, n);
+        }
+
+        const auto& rect = std::get<RectangleShape>(shape_);
+
+        return SampleArea(p, rect.origin + u1 * rect.a + u2 * rect.b,
+                          cross(rect.a, rect.b).normed());
+    }
+
+    // solid angle density of `Sample` picking `dir` from `p`, given that the ray from `p` in
+    // direction `dir` hits the light at `hit_record`
+    f64 Pdf(Point3 p, Vec3 dir, const HitRecord& hit_record) const {
+        if (const auto* sphere = std::get_if<SphereShape>(&shape_)) {
+            f64 d2 = (p - sphere->centre).squared();
+            f64 r2 = sphere->radius * sphere->radius;
+
+            if (d2 > r2) {
+                return 1 / (2 * kPi * ConeSolidAngleFraction(r2 / d2));
+            }
+        }
+
+        f64 cos = std::abs(dot(hit_record.normal, dir));
+
+        return cos > 0.0 ? hit_record.t * hit_record.t / (cos * area()) : 0.0;
+    }
+
+   private:
+    // 1 - cos(theta_max) of the cone subtended by a sphere, from sin^2(theta_max), without the
+    // cancellation for small (distant) spheres
+    static constexpr f64 ConeSolidAngleFraction(f64 sin2_max) {
+        return sin2_max / (1 + std::sqrt(std::max(0.0, 1 - sin2_max)));
+    }
+
+    std::optional<LightSample> SampleCone(const SphereShape& sphere, Point3 p, f64 u1,
+                                          f64 u2) const {
+        Vec3 to_centre = sphere.centre - p;
+        f64 d2 = to_centre.squared();
+
+        Vec3 w = to_centre / std::sqrt(d2);
+        auto [tangent, bitangent] = OrthonormalBasis(w);
+
+        f64 one_minus_cos_max = ConeSolidAngleFraction(sphere.radius * sphere.radius / d2);
+
+        f64 one_minus_cos = u1 * one_minus_cos_max;
+        f64 cos_theta = 1 - one_minus_cos;
+        f64 sin_theta = std::sqrt(std::max(0.0, one_minus_cos * (2 - one_minus_cos)));
+
+        f64 phi = 2 * kPi * u2;
+
+        Vec3 dir = sin_theta * std::cos(phi) * tangent + sin_theta * std::sin(phi) * bitangent +
+                   cos_theta * w;
+
+        auto ts = Ray{p, dir}.HitSphere(sphere.centre, sphere.radius);
+
+        if (!ts.has_value()) {
+            // grazing the silhouette
+            return std::nullopt;
+        }
+
+        return LightSample{dir.normed(), ts->first, emission_, 1 / (2 * kPi * one_minus_cos_max)};
+    }
+
+    std::optional<LightSample> SampleArea(Point3 p, Point3 q, Vec3 normal) const {
+        Vec3 to_light = q - p;
+        f64 dist2 = to_light.squared();
+
+        if (dist2 == 0.0) {
+            return std::nullopt;
+        }
+
+        f64 dist = std::sqrt(dist2);
+        Vec3 dir = to_light / dist;
+
+        f64 cos = std::abs(dot(normal, dir));
+
+        if (cos == 0.0) {
+            return std::nullopt;
+        }
+
+        return LightSample{dir, dist, emission_, dist2 / (cos * area())};
+    }
+
+    Shape shape_;
+    MaterialId mat_;
+    Colour emission_;
+};
+
+// importance of sampling strategy a against b by the power heuristic (Veach), given the densities
+// both assign to the sample
+constexpr f64 PowerHeuristic(f64 pdf_a, f64 pdf_b) {
+    f64 a2 = pdf_a * pdf_a;
+    f64 b2 = pdf_b * pdf_b;
+
+    return a2 + b2 > 0.0 ? a2 / (a2 + b2) : 0.0;
+}
+
+// the lights of a scene
+class LightList {
+   public:
+    LightList() = default;
+
+    // collect the lights of `world`
+    LightList(const RenderObject& world, const MaterialTable& materials) : materials_{&materials} {
+        world.AddLights(*this);
+
+        std::vector<LightBounds> bounds;
+        bounds.reserve(lights_.size());
+
+        for (const auto& light : lights_) {
+            bounds.push_back(light.Bounds());
+        }
+
+        bvh_ = LightBVH{bounds};
+    }
+
+    // called by `AddLights` for every primitive, i.e. part `prim` of `obj` as `intersect` reports
+    // it. Only emissive ones become lights.
+    void Add(const RenderObject& obj, u32 prim, Light::Shape shape, MaterialId mat) {
+        assert(materials_ != nullptr);
+
+        if (!materials_->IsEmissive(mat)) {
+            return;
+        }
+
+        [[maybe_unused]] bool inserted =
+            by_primitive_.emplace(Primitive{&obj, prim}, static_cast<u32>(lights_.size())).second;
+        assert(inserted);
+
+        lights_.emplace_back(shape, mat, materials_->Emission(mat));
+    }
+
+    bool empty() const { return lights_.empty(); }
+    u32 size() const { return static_cast<u32>(lights_.size()); }
+
+    const Light& operator[](u32 light) const {
+        assert(light < lights_.size());
+
+        return lights_[light];
+    }
+
+    // pick a light to sample from the point `p` with surface normal `n`, using the uniform `u`.
+    // Lights are picked in proportion to a bound on their contribution at `p` (see `LightBVH`).
+    // Returns the light and the probability of picking it, nullopt if no light reaches `p`.
+    std::optional<std::pair<u32, f64>> Choose(Point3 p, Vec3 n, f64 u) const {
+        return bvh_.Sample(p, n, u);
+    }
+
+    // probability of `Choose` picking `light` from `p` with normal `n`
+    f64 ChooseProbability(Point3 p, Vec3 n, u32 light) const { return bvh_.Pmf(p, n, light); }
+
+    // the light hit at `isect`, nullopt if the surface isn't one of ours
+    std::optional<u32> FromHit(const Intersection& isect) const {
+        // lights are not collected through instances, even if the object is also in the scene
+        if (isect.instance != nullptr) {
+            return std::nullopt;
+        }
+
+        auto it = by_primitive_.find(Primitive{isect.obj, isect.prim});
+
+        if (it == by_primitive_.end()) {
+            return std::nullopt;
+        }
+
+        return it->second;
+    }
+
+   private:
+    struct Primitive {
+        const RenderObject* obj;
+        u32 prim;
+
+        bool operator==(const Primitive&) const = default;
+    };
+
+    struct PrimitiveHash {
+        std::size_t operator()(const Primitive& p) const {
+            return std::hash<const RenderObject*>{}(p.obj) ^
+                   (std::hash<u32>{}(p.prim) * 0x9e3779b97f4a7c15);
+        }
+    };
+
+    const MaterialTable* materials_ = nullptr;
+
+    std::vector<Light> lights_;
+
+    // the light of each emissive primitive
+    std::unordered_map<Primitive, u32, PrimitiveHash> by_primitive_;
+
+    LightBVH bvh_;
+};
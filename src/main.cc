@@ -1,97 +1,305 @@
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
 
-#include "2dshapes.h"
+#include "accumbuffer.h"
+#include "bvh.h"
 #include "camera.h"
 #include "colour.h"
+#include "heatmap.h"
 #include "image.h"
 #include "material.h"
+#include "objloader.h"
 #include "raytracer.h"
 #include "renderer.h"
 #include "renderobjectlist.h"
-#include "sphere.h"
+#include "renderstats.h"
+#include "scenefile.h"
+#include "scenes.h"
+#include "threadpool.h"
 #include "vec3.h"
 
-int main(int /* argc */, char* /* argv */[]) {
+// keep a progress line on stderr up to date until stopped
+static void ShowProgress(std::stop_token stop, const Renderer& renderer) {
+    using namespace std::chrono_literals;
+
+    while (!stop.stop_requested()) {
+        auto progress = renderer.progress().Poll();
+
+        if (progress.work_total == 0) {
+            // not started yet
+            std::this_thread::sleep_for(10ms);
+            continue;
+        }
+
+        auto seconds = std::chrono::duration<f64>(progress.elapsed).count();
+        f64 mrays_per_s = seconds > 0.0 ? 1e-6 * static_cast<f64>(progress.rays) / seconds : 0.0;
+
+        std::cerr << "\rRendered " << progress.work_done << " of " << progress.work_total
+                  << " tiles, " << mrays_per_s << " Mrays/s    " << std::flush;
+
+        std::this_thread::sleep_for(100ms);
+    }
+
+    std::clog << "\rDone                                                " << newline;
+}
+
+static void PrintUsage(const char* name) {
+    std::cerr << "usage: " << name
+              << " [-j|--threads N] [-f|--format p3|p6|pfm] [--stream] [--adaptive ERROR]"
+                 " [--checkpoint FILE] [--overwrite-checkpoint] [--scene FILE]"
+                 " [--obj FILE]..."
+                 " [--cost boxes|tests|bounces|time]"
+              << newline;
+}
+
+// the number `str` spells out in full, nullopt if it is anything else
+template <typename T>
+static std::optional<T> ParseNumber(std::string_view str) {
+    T value{};
+
+    auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+
+    if (ec != std::errc{} || end != str.data() + str.size()) {
+        return std::nullopt;
+    }
+
+    return value;
+}
+
+int main(int argc, char* argv[]) {
+    // options
+
+    u32 num_threads = 0;  // one per hardware thread
+
+    ImageFormat format = ImageFormat::kP6;
+
+    // write finished bands as we go instead of keeping the whole frame in memory
+    bool stream = false;
+
+    // target error for adaptive sampling, 0 to take the same number of samples everywhere
+    f64 adaptive_error = 0.0;
+
+    // render progressively, checkpointing to (and resuming from) this file
+    std::string checkpoint;
+
+    // start over if the checkpoint is of another render instead of refusing to
+    bool overwrite_checkpoint = false;
+
+    // binary scene file to render instead of the built-in scene
+    std::string scene_path;
+
+    // OBJ meshes to add to the scene
+    std::vector<std::string> obj_paths;
+
+    // write a heatmap of this cost instead of the image: raw costs as PFM, false colour otherwise
+    std::optional<CostMetric> cost_metric;
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg{argv[i]};
+
+        if ((arg == "-j" || arg == "--threads") && i + 1 < argc) {
+            auto n = ParseNumber<u32>(argv[++i]);
+
+            if (!n.has_value()) {
+                PrintUsage(argv[0]);
+                return 1;
+            }
+
+            num_threads = *n;
+        } else if ((arg == "-f" || arg == "--format") && i + 1 < argc) {
+            std::string_view name{argv[++i]};
+
+            if (name == "p3") {
+                format = ImageFormat::kP3;
+            } else if (name == "p6") {
+                format = ImageFormat::kP6;
+            } else if (name == "pfm") {
+                format = ImageFormat::kPFM;
+            } else {
+                std::cerr << "unknown format " << name << newline;
+                return 1;
+            }
+        } else if (arg == "--stream") {
+            stream = true;
+        } else if (arg == "--adaptive" && i + 1 < argc) {
+            auto error = ParseNumber<f64>(argv[++i]);
+
+            if (!error.has_value() || !std::isfinite(*error) || *error < 0.0) {
+                PrintUsage(argv[0]);
+                return 1;
+            }
+
+            adaptive_error = *error;
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            checkpoint = argv[++i];
+        } else if (arg == "--overwrite-checkpoint") {
+            overwrite_checkpoint = true;
+        } else if (arg == "--scene" && i + 1 < argc) {
+            scene_path = argv[++i];
+        } else if (arg == "--obj" && i + 1 < argc) {
+            obj_paths.emplace_back(argv[++i]);
+        } else if (arg == "--cost" && i + 1 < argc) {
+            std::string_view name{argv[++i]};
+
+            cost_metric = ParseCostMetric(name);
+
+            if (!cost_metric.has_value()) {
+                std::cerr << "unknown cost metric " << name << newline;
+                return 1;
+            }
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (cost_metric.has_value() && (stream || !checkpoint.empty())) {
+        std::cerr << "--cost can't be combined with --stream or --checkpoint" << newline;
+        return 1;
+    }
+
     // world
 
     RenderObjectList world;
+    MaterialTable materials;
+    Camera camera{0, 0};
+
+    // the primitives of a scene file are used in place, so the mapping has to outlive the BVH
+    std::unique_ptr<MappedScene> scene;
+
+    // what the scene is made of, for telling checkpoints apart
+    Fingerprint scene_fingerprint;
+
+    if (!scene_path.empty()) {
+        try {
+            scene = std::make_unique<MappedScene>(scene_path);
+
+            world = scene->Objects();
+            materials = scene->materials();
+            camera = scene->camera();
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << newline;
+            return 1;
+        }
 
-    constexpr f64 focal_length = 5.0;
+        scene_fingerprint.Add(scene->bytes());
+    } else {
+        camera = DefaultScene(world, materials);
 
-    /* auto lamb = std::make_shared<Lambertian>(Colour{0.7, 0.0, 0.5});
-    auto metal = std::make_shared<Metal>(Colour{0.3, 0.3, 0.3});
+        scene_fingerprint.Add(std::string_view{"default"});
+    }
 
-    auto ground = std::make_unique<Sphere>(Point3{0, -100.5, -1}, 100, metal);
-    auto sphere = std::make_unique<Sphere>(-Vec3::e_z, 0.5, lamb);
+    const u32 image_width = camera.image_width();
+    const u32 image_height = camera.image_height();
 
-    world.Add(std::move(ground));
-    world.Add(std::move(sphere)); */
+    ThreadPool pool{num_threads};
 
-    auto mat_ground = std::make_shared<Lambertian>(Colour(0.8, 0.8, 0.0));
-    auto mat_lamb = std::make_shared<Lambertian>(Colour(1.0, 0.0, 0.0));
-    auto mat_metal = std::make_shared<Metal>(Colour(0.9, 0.4, 0.6), 0.0);
-    auto mat_metal2 = std::make_shared<Metal>(Colour(0.3, 0.5, 0.9), 0.0);
-    // auto mat_dielec = std::make_shared<Dielectric>(1.5, 0.0);
-    // auto mat_dielec2 = std::make_shared<Dielectric>(0.66, 0.0);
+    if (!obj_paths.empty()) {
+        auto mat_mesh = materials.Add(Lambertian{Colour(0.6, 0.6, 0.6)});
 
-    world.Add(std::make_unique<Sphere>(Point3(0, -100, 0), 100, mat_ground));
+        for (const auto& path : obj_paths) {
+            std::optional<TriangleMesh> loaded;
 
-    world.Add(std::make_unique<Rectangle>(Point3(-2.5, -2.5, 50), 5 * Vec3::e_x, 5 * Vec3::e_y,
-                                          mat_lamb));
+            try {
+                loaded.emplace(OBJLoader{path}.Load(mat_mesh, pool));
+            } catch (const std::exception& e) {
+                std::cerr << path << ": " << e.what() << newline;
+                return 1;
+            }
 
-    /* constexpr i32 N = 5;
+            const auto& mesh = world.Emplace<TriangleMesh>(std::move(*loaded));
 
-    for (i32 x = -N; x <= N; x++) {
-        for (i32 y = 0; y <= N; y++) {
-            world.Add(std::make_unique<Rectangle>(Point3(x, y, 50), Vec3::e_x, Vec3::e_y,
-                                                  (x + y) % 2 == 0 ? mat_lamb : mat_lamb2));
+            std::clog << path << ": " << mesh.size() << " triangles, " << mesh.build_stats()
+                      << newline;
+
+            scene_fingerprint.Add(std::as_bytes(mesh.positions()))
+                .Add(std::as_bytes(mesh.normals()))
+                .Add(mesh.indices());
         }
-    } */
+    }
 
-    // world.Add(std::make_unique<Sphere>(Point3(-1.0, 0.0, 0.0), 0.5, mat_dielec));
-    // world.Add(std::make_unique<Sphere>(Point3(-1.0, 0.0, 0.0), 0.4, mat_dielec2));
+    // render
 
-    // world.Add(std::make_unique<Sphere>(Point3{-1, 0, 0}, 0.5, mat_metal2));
+    BVH bvh{std::move(world), BVHBuildOptions{.pool = &pool}};
 
-    // world.Add(std::make_unique<Sphere>(Point3(1, 0, 0), 0.5, mat_metal));
+    std::clog << bvh.build_stats() << newline;
 
-    /* for (f64 z = 0.5; z < 10; z += 0.5) {
-        world.Add(std::make_unique<Sphere>(Point3(1, 0, z), 1 * z / focal_length, mat_metal));
-    } */
+    Renderer renderer{camera, pool};
 
-    // camera
+    if (adaptive_error > 0.0) {
+        renderer.adaptive() = true;
+        renderer.adaptive_error() = adaptive_error;
+    }
 
-    constexpr f64 aspect_ratio = 16.0 / 9.0;
+    renderer.cost_metric() = cost_metric;
 
-    constexpr u32 image_width = 1200;
-    constexpr auto image_height = static_cast<u32>(image_width / aspect_ratio);
+    // progressive rendering keeps its state in the checkpoint file
+    std::unique_ptr<AccumulationBuffer> accum;
 
-    // constexpr u32 image_width = 1920;
-    // constexpr u32 image_height = 1080;
+    if (!checkpoint.empty()) {
+        try {
+            accum = std::make_unique<AccumulationBuffer>(
+                checkpoint, renderer.ProgressiveKey(scene_fingerprint.value()),
+                overwrite_checkpoint);
+        } catch (const CheckpointMismatch& e) {
+            std::cerr << e.what() << ", use --overwrite-checkpoint to start over" << newline;
+            return 1;
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << newline;
+            return 1;
+        }
 
-    static_assert(image_height >= 1);
+        if (accum->resumed()) {
+            std::clog << "resuming " << checkpoint << " after pass " << accum->passes_done()
+                      << newline;
+        }
+    }
 
-    constexpr Point3 camera_centre{0, 1, -1};
+    RenderStats stats;
+    std::optional<Image> img;
 
-    Camera camera{camera_centre, image_width, image_height};
+    {
+        std::jthread progress_line{ShowProgress, std::cref(renderer)};
 
-    camera.look_at(Vec3{0, 0, 1});
-    camera.focal_length(focal_length);
+        if (accum != nullptr) {
+            img = renderer.RenderProgressive(bvh, materials, *accum, &stats);
+        } else if (stream) {
+            ImageStreamWriter out{std::cout, format, image_width, image_height};
 
-    camera.defocus_angle(1);
-    // camera.focal_length(1);
+            renderer.RenderStreaming(bvh, materials, out, &stats);
+        } else {
+            img = renderer.Render(bvh, materials, &stats);
+        }
+    }
 
-    // camera.fov(40);
-    // camera.centre(Point3{-2, 2, 1});
+    if (cost_metric.has_value() && format != ImageFormat::kPFM) {
+        f64 scale = CostScale(img.value());
 
-    // render
+        std::clog << CostMetricName(cost_metric.value()) << " per pixel: red is " << scale
+                  << " and up" << newline;
 
-    Renderer renderer{camera};
+        img = FalseColour(img.value(), scale);
+    }
 
-    auto img = renderer.Render(world);
+    if (img.has_value()) {
+        WriteImage(std::cout, img.value(), format, pool);
+    }
 
-    std::cout << img;
+    std::clog << stats << newline;
 
     return 0;
 }
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstddef>
 #include <optional>
 #include <tuple>
+#include <variant>
+#include <vector>
 
 #include "colour.h"
 #include "rand.h"
@@ -12,35 +16,26 @@
 #include "renderobject.h"
 #include "vec3.h"
 
-class Material {
-   public:
-    constexpr Material() = default;
-
-    constexpr Material(const Material&) = default;
-    Material& operator=(const Material&) = default;
-
-    constexpr Material(Material&&) = default;
-    Material& operator=(Material&&) = default;
-
-    virtual ~Material() = default;
-
-    virtual std::optional<std::tuple<Colour, Ray>> Scatter(const Ray& in,
-                                                           const HitRecord& hit_record) const = 0;
-
-   private:
+// value of a material for a given pair of directions, for sampling lights directly
+struct MaterialEval {
+    Colour f_cos;  // BRDF times the cosine of the outgoing direction
+    f64 pdf;       // solid angle density with which `Scatter` picks the outgoing direction
 };
 
-class Lambertian : public Material {
+class Lambertian {
    public:
     constexpr explicit Lambertian(Colour albedo) : albedo_{albedo} {}
 
-    std::optional<std::tuple<Colour, Ray>> Scatter(const Ray& /* in */,
-                                                   const HitRecord& hit_record) const override {
-        auto scatter_dir = hit_record.normal + RandomGen::GenInstance().UnitSphereVec3();
+    // `Scatter` picks directions with density cos / pi, so albedo is f * cos / pdf
+    constexpr MaterialEval Evaluate(const HitRecord& hit_record, Vec3 out_dir) const {
+        f64 cos = std::max(0.0, dot(hit_record.normal, out_dir));
 
-        if (scatter_dir.almost_zero()) {
-            scatter_dir = hit_record.normal;
-        }
+        return MaterialEval{(cos / kPi) * albedo_, cos / kPi};
+    }
+
+    std::optional<std::tuple<Colour, Ray>> Scatter(const Ray& /* in */,
+                                                   const HitRecord& hit_record) const {
+        auto scatter_dir = RandomGen::GenInstance().CosineHemisphereVec3(hit_record.normal);
 
         Ray scattered{hit_record.p, scatter_dir};
 
@@ -51,12 +46,12 @@ class Lambertian : public Material {
     Colour albedo_;
 };
 
-class Metal : public Material {
+class Metal {
    public:
     constexpr Metal(Colour albedo, f64 fuzz) : albedo_{albedo}, fuzz_{fuzz} { assert(fuzz <= 1); }
 
     std::optional<std::tuple<Colour, Ray>> Scatter(const Ray& in,
-                                                   const HitRecord& hit_record) const override {
+                                                   const HitRecord& hit_record) const {
         auto reflect_dir = in.direction().reflect(hit_record.normal).normed();
 
         reflect_dir += fuzz_ * RandomGen::GenInstance().UnitSphereVec3();
@@ -71,12 +66,12 @@ class Metal : public Material {
     f64 fuzz_;
 };
 
-class Dielectric : public Material {
+class Dielectric {
    public:
     constexpr explicit Dielectric(f64 eta, f64 fuzz) : eta_{eta}, fuzz_{fuzz} {}
 
     std::optional<std::tuple<Colour, Ray>> Scatter(const Ray& in,
-                                                   const HitRecord& hit_record) const override {
+                                                   const HitRecord& hit_record) const {
         auto& rand = RandomGen::GenInstance();
 
         f64 cos_theta = dot(-in.direction(), hit_record.normal);
@@ -112,3 +107,87 @@ class Dielectric : public Material {
     f64 eta_;  // index of refraction inside over outside
     f64 fuzz_;
 };
+
+// area light, emitting `emission` from both sides of its surface. It doesn't scatter, paths
+// end on it.
+class DiffuseLight {
+   public:
+    constexpr explicit DiffuseLight(Colour emission) : emission_{emission} {}
+
+    constexpr Colour emission() const { return emission_; }
+
+    std::optional<std::tuple<Colour, Ray>> Scatter(const Ray& /* in */,
+                                                   const HitRecord& /* hit_record */) const {
+        return std::nullopt;
+    }
+
+   private:
+    Colour emission_;
+};
+
+// closed set of materials, dispatched with std::visit instead of virtual calls
+using Material = std::variant<Lambertian, Metal, Dielectric, DiffuseLight>;
+
+// all materials of a scene in one contiguous array, objects refer to them by index
+class MaterialTable {
+   public:
+    MaterialTable() = default;
+
+    MaterialId Add(const Material& mat) {
+        mats_.push_back(mat);
+
+        return static_cast<MaterialId>(mats_.size() - 1);
+    }
+
+    std::size_t size() const { return mats_.size(); }
+
+    const Material& operator[](MaterialId id) const {
+        assert(id < mats_.size());
+
+        return mats_[id];
+    }
+
+    std::optional<std::tuple<Colour, Ray>> Scatter(const Ray& in,
+                                                   const HitRecord& hit_record) const {
+        return std::visit([&](const auto& mat) { return mat.Scatter(in, hit_record); },
+                          (*this)[hit_record.mat]);
+    }
+
+    bool IsEmissive(MaterialId id) const {
+        return std::holds_alternative<DiffuseLight>((*this)[id]);
+    }
+
+    // radiance emitted by surfaces of material `id`
+    Colour Emission(MaterialId id) const {
+        const auto* light = std::get_if<DiffuseLight>(&(*this)[id]);
+
+        return light != nullptr ? light->emission() : Colour::kBlack;
+    }
+
+    // whether the material can be evaluated for any direction, which sampling lights directly
+    // needs. Mirrors and glass scatter into (nearly) a single direction, so they can't.
+    bool IsDiffuse(MaterialId id) const {
+        return std::visit(
+            [](const auto& mat) {
+                return requires(const HitRecord& hit_record) { mat.Evaluate(hit_record, Vec3{}); };
+            },
+            (*this)[id]);
+    }
+
+    MaterialEval Evaluate(const HitRecord& hit_record, Vec3 out_dir) const {
+        assert(IsDiffuse(hit_record.mat));
+
+        return std::visit(
+            [&](const auto& mat) {
+                if constexpr (requires { mat.Evaluate(hit_record, out_dir); }) {
+                    return mat.Evaluate(hit_record, out_dir);
+                } else {
+                    return MaterialEval{Colour::kBlack, 0.0};
+                }
+            },
+            (*this)[hit_record.mat]);
+    }
+
+   private:
+    std::vector<Material> mats_;
+};
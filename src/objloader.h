@@ -0,0 +1,403 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "bvh.h"
+#include "raytracer.h"
+#include "renderobject.h"
+#include "threadpool.h"
+#include "trianglemesh.h"
+#include "vec3.h"
+
+// Wavefront OBJ loading: `v`, `vn` and `f` statements are read, everything else (texture
+// coordinates, groups, materials, ...) is skipped. Polygons are split into triangle fans.
+//
+// the file is split into chunks at line boundaries that are parsed in parallel, in two passes: the
+// first counts the vertices, normals and triangles of every chunk, which gives each chunk its
+// offsets into the mesh buffers, the second parses straight into them.
+//
+// errors are thrown without the file's name, which the caller knows.
+class OBJLoader {
+   public:
+    explicit OBJLoader(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "open");
+        }
+
+        struct stat st {};
+
+        if (fstat(fd, &st) < 0) {
+            int err = errno;
+            close(fd);
+            throw std::system_error(err, std::generic_category(), "stat");
+        }
+
+        size_ = static_cast<std::size_t>(st.st_size);
+
+        if (size_ > 0) {
+            void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (data == MAP_FAILED) {
+                int err = errno;
+                close(fd);
+                throw std::system_error(err, std::generic_category(), "mmap");
+            }
+
+            data_ = static_cast<const char*>(data);
+        }
+
+        close(fd);
+    }
+
+    OBJLoader(const OBJLoader&) = delete;
+    OBJLoader& operator=(const OBJLoader&) = delete;
+
+    OBJLoader(OBJLoader&&) = delete;
+    OBJLoader& operator=(OBJLoader&&) = delete;
+
+    ~OBJLoader() {
+        if (data_ != nullptr) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+    }
+
+    // parse the file on `pool` and build a mesh (including its BVH) with material `mat`
+    TriangleMesh Load(MaterialId mat, ThreadPool& pool) const {
+        std::vector<Chunk> chunks = Split(pool.size());
+
+        const auto num_chunks = static_cast<u32>(chunks.size());
+
+        pool.ParallelFor(0, num_chunks, [&](u32 i) { Count(chunks[i]); });
+
+        // offsets of every chunk into the buffers, and the totals
+        Counts total;
+
+        for (auto& chunk : chunks) {
+            Counts counts = chunk.counts;
+
+            chunk.counts = total;
+
+            total.positions += counts.positions;
+            total.normals += counts.normals;
+            total.triangles += counts.triangles;
+            total.faces_with_normals += counts.faces_with_normals;
+            total.faces += counts.faces;
+        }
+
+        if (total.faces_with_normals != 0 && total.faces_with_normals != total.faces) {
+            throw std::runtime_error("either all or no faces must have normals");
+        }
+
+        Buffers buffers;
+
+        buffers.positions.resize(total.positions);
+        buffers.normals.resize(total.normals);
+        buffers.indices.resize(3 * total.triangles);
+
+        if (total.faces_with_normals > 0) {
+            buffers.normal_indices.resize(3 * total.triangles);
+        }
+
+        pool.ParallelFor(0, num_chunks, [&](u32 i) { Parse(chunks[i], buffers); });
+
+        for (const auto& chunk : chunks) {
+            if (!chunk.error.empty()) {
+                throw std::runtime_error(chunk.error);
+            }
+        }
+
+        return TriangleMesh{std::move(buffers.positions), std::move(buffers.normals),
+                            std::move(buffers.indices), std::move(buffers.normal_indices), mat,
+                            BVHBuildOptions{.pool = &pool}};
+    }
+
+   private:
+    // chunks smaller than this aren't worth a task
+    static constexpr std::size_t kMinChunkSize = 1 << 20;
+
+    struct Counts {
+        std::size_t positions = 0;
+        std::size_t normals = 0;
+        std::size_t triangles = 0;
+
+        std::size_t faces = 0;
+        std::size_t faces_with_normals = 0;
+    };
+
+    struct Chunk {
+        std::string_view text;
+
+        // after counting: the chunk's own counts, then its offsets into the buffers
+        Counts counts;
+
+        std::string error;
+    };
+
+    struct Buffers {
+        std::vector<Point3> positions;
+        std::vector<Vec3> normals;
+
+        std::vector<u32> indices;
+        std::vector<u32> normal_indices;
+    };
+
+    // one face corner, indices as written in the file (1-based, negative relative to the end)
+    struct Corner {
+        i64 position = 0;
+        std::optional<i64> normal = std::nullopt;
+    };
+
+    std::vector<Chunk> Split(u32 num_workers) const {
+        std::string_view text{data_, size_};
+
+        std::size_t num_chunks = std::max<std::size_t>(
+            1, std::min<std::size_t>(4 * std::size_t{num_workers}, size_ / kMinChunkSize));
+
+        std::vector<Chunk> chunks;
+
+        std::size_t begin = 0;
+
+        for (std::size_t i = 1; i <= num_chunks && begin < text.size(); i++) {
+            std::size_t end = i == num_chunks ? text.size() : text.size() * i / num_chunks;
+
+            // extend to the end of the line
+            end = std::max(end, begin);
+            end = std::min(text.find('\n', end), text.size());
+
+            chunks.push_back(Chunk{text.substr(begin, end - begin), {}, {}});
+
+            begin = end + 1;
+        }
+
+        return chunks;
+    }
+
+    static bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    // split the first line off the front of `text`
+    static std::string_view NextLine(std::string_view& text) {
+        std::size_t end = std::min(text.find('\n'), text.size());
+
+        std::string_view line = text.substr(0, end);
+        text.remove_prefix(std::min(end + 1, text.size()));
+
+        return line;
+    }
+
+    // split the next whitespace separated token off the front of `line`
+    static std::string_view NextToken(std::string_view& line) {
+        std::size_t begin = 0;
+
+        while (begin < line.size() && IsSpace(line[begin])) {
+            begin++;
+        }
+
+        std::size_t end = begin;
+
+        while (end < line.size() && !IsSpace(line[end])) {
+            end++;
+        }
+
+        std::string_view token = line.substr(begin, end - begin);
+        line.remove_prefix(end);
+
+        return token;
+    }
+
+    template <typename T>
+    static std::optional<T> ParseNumber(std::string_view token) {
+        T value{};
+
+        auto [end, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+
+        if (ec != std::errc{} || end != token.data() + token.size()) {
+            return std::nullopt;
+        }
+
+        return value;
+    }
+
+    // `v`, `v/vt`, `v//vn` or `v/vt/vn`
+    static std::optional<Corner> ParseCorner(std::string_view token) {
+        std::size_t slash = token.find('/');
+
+        auto position = ParseNumber<i64>(token.substr(0, slash));
+
+        if (!position.has_value()) {
+            return std::nullopt;
+        }
+
+        Corner corner{position.value(), std::nullopt};
+
+        if (slash == std::string_view::npos) {
+            return corner;
+        }
+
+        std::size_t second_slash = token.find('/', slash + 1);
+
+        if (second_slash == std::string_view::npos) {
+            return corner;
+        }
+
+        corner.normal = ParseNumber<i64>(token.substr(second_slash + 1));
+
+        if (!corner.normal.has_value()) {
+            return std::nullopt;
+        }
+
+        return corner;
+    }
+
+    static void Count(Chunk& chunk) {
+        std::string_view text = chunk.text;
+
+        while (!text.empty()) {
+            std::string_view line = NextLine(text);
+            std::string_view keyword = NextToken(line);
+
+            if (keyword == "v") {
+                chunk.counts.positions++;
+            } else if (keyword == "vn") {
+                chunk.counts.normals++;
+            } else if (keyword == "f") {
+                std::size_t num_corners = 0;
+                bool has_normals = false;
+
+                for (auto token = NextToken(line); !token.empty(); token = NextToken(line)) {
+                    num_corners++;
+                    has_normals = token.find("//") != std::string_view::npos ||
+                                  std::ranges::count(token, '/') == 2;
+                }
+
+                chunk.counts.triangles += num_corners >= 3 ? num_corners - 2 : 0;
+                chunk.counts.faces++;
+                chunk.counts.faces_with_normals += has_normals ? 1 : 0;
+            }
+        }
+    }
+
+    void Parse(Chunk& chunk, Buffers& buffers) const {
+        std::string_view text = chunk.text;
+
+        std::size_t num_positions = chunk.counts.positions;
+        std::size_t num_normals = chunk.counts.normals;
+        std::size_t num_triangles = chunk.counts.triangles;
+
+        const bool with_normals = !buffers.normal_indices.empty();
+
+        // OBJ indices are 1-based, negative ones count back from the last vertex so far
+        auto resolve = [](i64 idx, std::size_t so_far, std::size_t total) -> std::optional<u32> {
+            i64 resolved = idx > 0 ? idx - 1 : static_cast<i64>(so_far) + idx;
+
+            if (idx == 0 || resolved < 0 || static_cast<std::size_t>(resolved) >= total) {
+                return std::nullopt;
+            }
+
+            return static_cast<u32>(resolved);
+        };
+
+        auto parse_vec = [](std::string_view& line) -> std::optional<Vec3> {
+            auto x = ParseNumber<f64>(NextToken(line));
+            auto y = ParseNumber<f64>(NextToken(line));
+            auto z = ParseNumber<f64>(NextToken(line));
+
+            if (!x.has_value() || !y.has_value() || !z.has_value()) {
+                return std::nullopt;
+            }
+
+            return Vec3{x.value(), y.value(), z.value()};
+        };
+
+        auto fail = [&chunk](std::string_view what, std::string_view line) {
+            chunk.error = std::string{what} + " '" + std::string{line} + "'";
+        };
+
+        while (!text.empty()) {
+            std::string_view line = NextLine(text);
+            std::string_view rest = line;
+            std::string_view keyword = NextToken(rest);
+
+            if (keyword == "v") {
+                auto v = parse_vec(rest);
+
+                if (!v.has_value()) {
+                    return fail("bad vertex", line);
+                }
+
+                buffers.positions[num_positions++] = v.value();
+            } else if (keyword == "vn") {
+                auto n = parse_vec(rest);
+
+                if (!n.has_value()) {
+                    return fail("bad normal", line);
+                }
+
+                buffers.normals[num_normals++] = n.value();
+            } else if (keyword == "f") {
+                std::array<u32, 2> first{};  // position and normal index of the fan's apex
+                std::array<u32, 2> prev{};
+
+                u32 corner_idx = 0;
+
+                for (auto token = NextToken(rest); !token.empty(); token = NextToken(rest)) {
+                    auto corner = ParseCorner(token);
+
+                    if (!corner.has_value() || corner->normal.has_value() != with_normals) {
+                        return fail("bad face", line);
+                    }
+
+                    auto p = resolve(corner->position, num_positions, buffers.positions.size());
+                    auto n = with_normals ? resolve(corner->normal.value(), num_normals,
+                                                    buffers.normals.size())
+                                          : std::optional<u32>{0};
+
+                    if (!p.has_value() || !n.has_value()) {
+                        return fail("index out of range in face", line);
+                    }
+
+                    std::array<u32, 2> cur{p.value(), n.value()};
+
+                    if (corner_idx == 0) {
+                        first = cur;
+                    } else if (corner_idx >= 2) {
+                        std::size_t at = 3 * num_triangles++;
+
+                        buffers.indices[at] = first[0];
+                        buffers.indices[at + 1] = prev[0];
+                        buffers.indices[at + 2] = cur[0];
+
+                        if (with_normals) {
+                            buffers.normal_indices[at] = first[1];
+                            buffers.normal_indices[at + 1] = prev[1];
+                            buffers.normal_indices[at + 2] = cur[1];
+                        }
+                    }
+
+                    prev = cur;
+                    corner_idx++;
+                }
+            }
+        }
+    }
+
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+};
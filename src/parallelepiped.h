@@ -5,6 +5,7 @@
 #include <optional>
 #include <utility>
 
+#include "aabb.h"
 #include "interval.h"
 #include "ray.h"
 #include "raytracer.h"
@@ -46,7 +47,7 @@ class Parallelepiped : public RenderObject {
     constexpr f64 b() const { return b_; }
     constexpr f64 c() const { return c_; }
 
-    std::optional<HitRecord> hit(const Ray& ray, Interval ts) const override {
+    bool intersect(const Ray& ray, Interval ts, Intersection& /* isect */) const override {
         // check if ray intersects outsphere first
         const f64 radius_ = (a_ * u_ + b_ * v_ + c_ * w_).norm() / 2;
 
@@ -60,7 +61,7 @@ class Parallelepiped : public RenderObject {
 
         if (discr < 0) {
             // miss
-            return std::nullopt;
+            return false;
         }
 
         // since the sphere completely envelops the cuboid
@@ -72,7 +73,7 @@ class Parallelepiped : public RenderObject {
             // if the smaller t is already too large, we don't need to check the second one since it
             // will be even larger
 
-            return std::nullopt;
+            return false;
         }
 
         if (t <= ts.min()) {
@@ -83,11 +84,19 @@ class Parallelepiped : public RenderObject {
             if (!ts.surronds(t)) {
                 // larger t also out of range: return false
 
-                return std::nullopt;
+                return false;
             }
         }
     }
 
+    AABB bounds() const override {
+        // bound the outsphere, same as `hit` tests against first
+        const f64 radius = (a_ * u_ + b_ * v_ + c_ * w_).norm() / 2;
+
+        Vec3 r{radius, radius, radius};
+        return AABB{centre_ - r, centre_ + r};
+    }
+
    private:
     Point3 centre_;
 
@@ -1,10 +1,42 @@
 #pragma once
 
-#include <philox.hh>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <span>
 
 #include "raytracer.h"
 #include "vec3.h"
 
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3"): a bijection of a
+// 128 bit counter under a 64 bit key, so any (key, counter) pair can be evaluated independently
+constexpr std::array<u32, 4> Philox4x32(std::array<u32, 4> ctr, std::array<u32, 2> key) {
+    constexpr u32 kMul0 = 0xD2511F53;
+    constexpr u32 kMul1 = 0xCD9E8D57;
+
+    constexpr u32 kWeyl0 = 0x9E3779B9;
+    constexpr u32 kWeyl1 = 0xBB67AE85;
+
+    for (u32 round = 0; round < 10; round++) {
+        u64 prod0 = u64{kMul0} * ctr[0];
+        u64 prod1 = u64{kMul1} * ctr[2];
+
+        ctr = {static_cast<u32>(prod1 >> 32) ^ ctr[1] ^ key[0], static_cast<u32>(prod1),
+               static_cast<u32>(prod0 >> 32) ^ ctr[3] ^ key[1], static_cast<u32>(prod0)};
+
+        key[0] += kWeyl0;
+        key[1] += kWeyl1;
+    }
+
+    return ctr;
+}
+
+// known answer test from the Random123 distribution
+static_assert(Philox4x32({0, 0, 0, 0}, {0, 0}) ==
+              std::array<u32, 4>{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8});
+
 class RandomGen {
    public:
     constexpr RandomGen(const RandomGen&) = delete;
@@ -21,10 +53,37 @@ class RandomGen {
         return rand;
     }
 
-    constexpr u64 U64() { return philox_.Next(); }
+    // restart on the stream of sample `sample` of pixel `pixel`, at bounce 0. All following draws
+    // are a function of (seed, pixel, sample, bounce, dimension) alone, not of the thread or of
+    // the order in which pixels are rendered.
+    constexpr void StartSample(u32 seed, u32 pixel, u32 sample) {
+        key_ = {pixel, seed};
+        counter_ = {0, sample, 0, kSampleDomain};
+
+        StartBounce(0);
+    }
+
+    // move the current sample's stream to bounce `bounce`, so that later bounces don't depend on
+    // how many numbers earlier ones consumed (e.g. in rejection sampling)
+    constexpr void StartBounce(u32 bounce) {
+        counter_[0] = 0;  // dimension
+        counter_[2] = bounce;
+
+        buf_idx_ = buf_.size();
+    }
+
+    constexpr u64 U64() {
+        if (buf_idx_ == buf_.size()) {
+            buf_ = NextBlock();
+            buf_idx_ = 0;
+        }
+
+        return buf_[buf_idx_++];
+    }
     // constexpr u32 GenU32() { return static_cast<u32>(GenU64()); }
 
-    constexpr f64 Uniform() { return philox_.NextF64(); }
+    // uniform in [0, 1) with 53 bits of precision
+    constexpr f64 Uniform() { return ToUniform(U64()); }
 
     constexpr f64 Uniform(f64 min, f64 max) { return min + (max - min) * Uniform(); }
 
@@ -34,17 +93,44 @@ class RandomGen {
         return Vec3{Uniform(min, max), Uniform(min, max), Uniform(min, max)};
     }
 
-    constexpr Vec3 UnitBallVec3() {
-        while (true) {
-            Vec3 v = UniformVec3(-1.0, 1.0);
+    // fill `out` with the same numbers `out.size()` calls to `Uniform()` would return, taking
+    // whole Philox blocks at a time
+    constexpr void Uniform(std::span<f64> out) {
+        std::size_t i = 0;
 
-            if (v.norm() < 1.0) {
-                return v;
-            }
+        for (; i < out.size() && buf_idx_ < buf_.size(); i++) {
+            out[i] = Uniform();
         }
+
+        for (; i + 2 <= out.size(); i += 2) {
+            auto block = NextBlock();
+
+            out[i] = ToUniform(block[0]);
+            out[i + 1] = ToUniform(block[1]);
+        }
+
+        for (; i < out.size(); i++) {
+            out[i] = Uniform();
+        }
+    }
+
+    // the samplers below map uniforms to their distribution in closed form, without rejection
+    // loops, and have batched versions that draw all uniforms up front
+
+    // (the uniforms are drawn into locals first, function arguments have no evaluation order)
+
+    constexpr Vec3 UnitSphereVec3() {
+        f64 u1 = Uniform();
+        f64 u2 = Uniform();
+
+        return SphereFromUniforms(u1, u2);
     }
 
-    constexpr Vec3 UnitSphereVec3() { return UnitBallVec3().normed(); }
+    constexpr Vec3 UnitBallVec3() {
+        Vec3 dir = UnitSphereVec3();
+
+        return std::cbrt(Uniform()) * dir;
+    }
 
     constexpr Vec3 HemisphereVec3(Vec3 normal) {
         Vec3 v = UnitSphereVec3();
@@ -56,19 +142,146 @@ class RandomGen {
         return v;
     }
 
+    // cosine weighted direction in the hemisphere around the unit vector `normal`, which is what
+    // a Lambertian surface scatters into
+    constexpr Vec3 CosineHemisphereVec3(Vec3 normal) {
+        auto [tangent, bitangent] = OrthonormalBasis(normal);
+
+        f64 u1 = Uniform();
+        f64 u2 = Uniform();
+
+        Vec3 local = CosineHemisphereFromUniforms(u1, u2);
+
+        return local.x() * tangent + local.y() * bitangent + local.z() * normal;
+    }
+
+    // uniform in the unit disk in the xy plane
+    constexpr Vec3 UnitDiskVec3() {
+        f64 u1 = Uniform();
+        f64 u2 = Uniform();
+
+        return ConcentricDisk(u1, u2);
+    }
+
+    // uniform in the unit disk orthogonal to the unit vector `normal`
     constexpr Vec3 UnitDiskVec3(Vec3 normal) {
-        while (true) {
-            Vec3 v = UniformVec3();
-            v -= dot(v, normal) * normal;
+        auto [tangent, bitangent] = OrthonormalBasis(normal);
 
-            if (v.norm() < 1) {
-                return v;
-            }
+        Vec3 local = UnitDiskVec3();
+
+        return local.x() * tangent + local.y() * bitangent;
+    }
+
+    constexpr void UnitSphereVec3(std::span<Vec3> out) {
+        ForEachBatch(out, [](f64 u1, f64 u2) { return SphereFromUniforms(u1, u2); });
+    }
+
+    constexpr void CosineHemisphereVec3(Vec3 normal, std::span<Vec3> out) {
+        auto [tangent, bitangent] = OrthonormalBasis(normal);
+
+        ForEachBatch(out, [&](f64 u1, f64 u2) {
+            Vec3 local = CosineHemisphereFromUniforms(u1, u2);
+
+            return local.x() * tangent + local.y() * bitangent + local.z() * normal;
+        });
+    }
+
+    constexpr void UnitDiskVec3(std::span<Vec3> out) {
+        ForEachBatch(out, [](f64 u1, f64 u2) { return ConcentricDisk(u1, u2); });
+    }
+
+    // z = cos(theta) is uniform in [-1, 1] on the sphere (Archimedes)
+    static constexpr Vec3 SphereFromUniforms(f64 u1, f64 u2) {
+        f64 z = 1.0 - 2.0 * u1;
+        f64 r = std::sqrt(std::max(0.0, 1.0 - z * z));
+        f64 phi = 2.0 * kPi * u2;
+
+        return Vec3{r * std::cos(phi), r * std::sin(phi), z};
+    }
+
+    // Shirley and Chiu's concentric mapping of the unit square onto the unit disk, which keeps
+    // strata of the square compact on the disk
+    static constexpr Vec3 ConcentricDisk(f64 u1, f64 u2) {
+        f64 a = 2.0 * u1 - 1.0;
+        f64 b = 2.0 * u2 - 1.0;
+
+        if (a == 0.0 && b == 0.0) {
+            return Vec3::origin;
+        }
+
+        f64 r = 0.0;
+        f64 phi = 0.0;
+
+        if (std::fabs(a) > std::fabs(b)) {
+            r = a;
+            phi = (kPi / 4) * (b / a);
+        } else {
+            r = b;
+            phi = (kPi / 2) - (kPi / 4) * (a / b);
         }
+
+        return Vec3{r * std::cos(phi), r * std::sin(phi), 0.0};
+    }
+
+    // Malley's method: project a uniform disk sample up onto the hemisphere around +z
+    static constexpr Vec3 CosineHemisphereFromUniforms(f64 u1, f64 u2) {
+        Vec3 d = ConcentricDisk(u1, u2);
+
+        f64 z = std::sqrt(std::max(0.0, 1.0 - d.x() * d.x() - d.y() * d.y()));
+
+        return Vec3{d.x(), d.y(), z};
     }
 
    private:
-    RandomGen() = default;
+    // number of samples the batched samplers generate per round of uniforms
+    static constexpr std::size_t kBatchSize = 32;
+
+    // the last counter word separates per-sample streams from the free running ones below
+    static constexpr u32 kSampleDomain = 0;
+    static constexpr u32 kThreadDomain = 1;
+
+    // every thread starts on its own stream, used for draws outside of `StartSample`
+    RandomGen() {
+        u64 stream = next_stream_.fetch_add(1);
+
+        key_ = {static_cast<u32>(stream), static_cast<u32>(stream >> 32)};
+        counter_ = {0, 0, 0, kThreadDomain};
+    }
+
+    static constexpr f64 ToUniform(u64 x) { return static_cast<f64>(x >> 11) * 0x1.0p-53; }
+
+    // next 128 bits of the current stream
+    constexpr std::array<u64, 2> NextBlock() {
+        auto out = Philox4x32(counter_, key_);
+
+        counter_[0]++;
+
+        return {(u64{out[0]} << 32) | out[1], (u64{out[2]} << 32) | out[3]};
+    }
+
+    // fill `out` with `sample(u1, u2)`, drawing the uniforms for a batch at a time so the mapping
+    // runs as a plain loop
+    template <typename F>
+    constexpr void ForEachBatch(std::span<Vec3> out, F&& sample) {
+        std::array<f64, 2 * kBatchSize> u{};
+
+        for (std::size_t first = 0; first < out.size(); first += kBatchSize) {
+            std::size_t n = std::min(kBatchSize, out.size() - first);
+
+            Uniform(std::span{u}.first(2 * n));
+
+            for (std::size_t i = 0; i < n; i++) {
+                out[first + i] = sample(u[2 * i], u[2 * i + 1]);
+            }
+        }
+    }
+
+    static inline std::atomic_uint64_t next_stream_ = 0;
+
+    std::array<u32, 2> key_{};
+    std::array<u32, 4> counter_{};  // dimension, sample, bounce, domain
 
-    Philox philox_;
+    // Philox produces 128 bits at a time, hand them out as two u64s
+    std::array<u64, 2> buf_{};
+    std::size_t buf_idx_ = buf_.size();
 };
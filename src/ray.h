@@ -1,34 +1,69 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
+#include <concepts>
 #include <iostream>
+#include <limits>
 #include <optional>
 #include <utility>
 
 #include "raytracer.h"
 #include "vec3.h"
 
-class Ray {
+// largest coordinate magnitude we expect in a scene, used to size precision-dependent tolerances
+template <std::floating_point T>
+constexpr T kMaxSceneExtent = T{1000};
+
+// start of the interval searched by rays leaving a surface, so they don't hit it again at t ~ 0.
+// A hit point is only known up to a few ulps of its coordinates, so in float this has to grow
+// with the scene extent; in double the fixed 1e-3 is far above that.
+template <std::floating_point T>
+constexpr T kSelfIntersectEps =
+    std::max(static_cast<T>(1e-3), 32 * std::numeric_limits<T>::epsilon() * kMaxSceneExtent<T>);
+
+// double keeps the offset the renderer always used. Whether secondary rays really clear their
+// surface at the scene extent is tested in tests/selfintersect.cc, at both precisions.
+static_assert(kSelfIntersectEps<f64> == 1e-3);
+
+// a ray spawned at the scene extent must actually move by the epsilon
+static_assert(kMaxSceneExtent<f64> + kSelfIntersectEps<f64> > kMaxSceneExtent<f64>);
+static_assert(kMaxSceneExtent<f32> + kSelfIntersectEps<f32> > kMaxSceneExtent<f32>);
+
+// float needs the larger margin, but still well below anything visible in a unit-sized scene
+static_assert(kSelfIntersectEps<f32> > kSelfIntersectEps<f64>);
+static_assert(kSelfIntersectEps<f32> < 1e-2f);
+
+template <std::floating_point T>
+class BasicRay {
    public:
-    constexpr Ray() = default;
+    using Scalar = T;
+    using Vec = BasicVec3<T>;
+
+    constexpr BasicRay() = default;
 
-    constexpr Ray(const Point3& origin, Vec3 direction) : orig_{origin}, dir_{direction.normed()} {}
+    constexpr BasicRay(const Vec& origin, Vec direction)
+        : orig_{origin}, dir_{direction.normed()} {}
 
-    Point3 origin() const { return orig_; }
-    Vec3 direction() const { return dir_; }
+    template <std::floating_point U>
+    constexpr explicit BasicRay(const BasicRay<U>& other)
+        : orig_{other.origin()}, dir_{other.direction()} {}
 
-    constexpr Point3 At(f64 t) const { return orig_ + t * dir_; }
+    Vec origin() const { return orig_; }
+    Vec direction() const { return dir_; }
+
+    constexpr Vec At(T t) const { return orig_ + t * dir_; }
 
     // return ts at which the ray intersects sphere or nullopt if no intersection
     // ts may the the same if tangential
-    constexpr std::optional<std::pair<f64, f64>> HitSphere(Point3 centre, f64 radius) const {
-        Vec3 oc = origin() - centre;
+    constexpr std::optional<std::pair<T, T>> HitSphere(Vec centre, T radius) const {
+        Vec oc = origin() - centre;
 
-        f64 a = 1.0;  // direction().squared() is always 1
-        f64 b_half = dot(oc, direction());
-        f64 c = oc.squared() - radius * radius;
+        T a = 1;  // direction().squared() is always 1
+        T b_half = dot(oc, direction());
+        T c = oc.squared() - radius * radius;
 
-        f64 discr = b_half * b_half - a * c;
+        T discr = b_half * b_half - a * c;
 
         if (discr < 0) {
             // miss
@@ -41,19 +76,22 @@ class Ray {
     }
 
     // return t a which the ray intersects the plane containing `v` with normal `normal`
-    std::optional<f64> HitPlane(Point3 v, Vec3 normal) const {
+    std::optional<T> HitPlane(Vec v, Vec normal) const {
         // if the ray is parallel to the plane, return nullopt, even  if the ray runs inside the
         // plane!
         if (is_zero(dot(direction(), normal))) {
             return std::nullopt;
         }
 
-        f64 t = dot(v - origin(), normal) / dot(direction(), normal);
+        T t = dot(v - origin(), normal) / dot(direction(), normal);
 
         return t;
     }
 
    private:
-    Point3 orig_;
-    Vec3 dir_;  // unit vector
+    Vec orig_;
+    Vec dir_;  // unit vector
 };
+
+using Ray = BasicRay<f64>;
+using Rayf = BasicRay<f32>;
@@ -2,6 +2,7 @@
 
 #include <cassert>
 #include <cmath>
+#include <concepts>
 #include <cstdint>
 #include <limits>
 #include <numbers>
@@ -12,10 +13,16 @@ using u64 = uint64_t;
 using i32 = int32_t;
 using i64 = int64_t;
 
+using f32 = float;
 using f64 = double;
 
-constexpr f64 kInf = std::numeric_limits<f64>::infinity();
-constexpr f64 kNan = std::numeric_limits<f64>::signaling_NaN();
+template <std::floating_point T>
+constexpr T kInfOf = std::numeric_limits<T>::infinity();
+template <std::floating_point T>
+constexpr T kNanOf = std::numeric_limits<T>::signaling_NaN();
+
+constexpr f64 kInf = kInfOf<f64>;
+constexpr f64 kNan = kNanOf<f64>;
 
 constexpr f64 kPi = std::numbers::pi_v<f64>;
 
@@ -23,9 +30,13 @@ constexpr char newline = '\n';
 
 constexpr u32 FToU8(f64 x) { return static_cast<u32>(255.999 * x); }
 
-constexpr f64 deg2rad(f64 deg) { return deg * kPi / 180.0; }
+template <std::floating_point T>
+constexpr T deg2rad(T deg) {
+    return deg * std::numbers::pi_v<T> / T{180};
+}
 
-constexpr bool is_zero(f64 x, f64 atol = 1e-5) {
-    assert(atol >= 0.0);
+template <std::floating_point T>
+constexpr bool is_zero(T x, T atol = static_cast<T>(1e-5)) {
+    assert(atol >= T{0});
     return std::fabs(x) < atol;
 }
@@ -2,28 +2,38 @@
 
 #include <sys/sysinfo.h>
 
+#include <algorithm>
 #include <array>
-#include <atomic>
 #include <cassert>
 #include <chrono>
-#include <iostream>
-#include <thread>
+#include <memory>
+#include <optional>
+#include <vector>
 
+#include "accumbuffer.h"
 #include "camera.h"
 #include "colour.h"
+#include "heatmap.h"
 #include "image.h"
 #include "interval.h"
+#include "lights.h"
 #include "material.h"
 #include "rand.h"
 #include "ray.h"
 #include "raytracer.h"
 #include "renderobject.h"
+#include "renderstats.h"
+#include "threadpool.h"
 #include "vec3.h"
 
 class Renderer {
    public:
-    constexpr explicit Renderer(Camera camera, u32 samples_per_pixel = 100, u32 max_bounces = 50)
-        : camera_{camera}, samples_per_pixel_{samples_per_pixel}, max_bounces_{max_bounces} {}
+    constexpr Renderer(Camera camera, ThreadPool& pool, u32 samples_per_pixel = 100,
+                       u32 max_bounces = 50)
+        : camera_{camera},
+          pool_{&pool},
+          samples_per_pixel_{samples_per_pixel},
+          max_bounces_{max_bounces} {}
 
     constexpr u32& samples_per_pixel() { return samples_per_pixel_; }
     constexpr u32 samples_per_pixel() const { return samples_per_pixel_; }
@@ -31,65 +41,433 @@ class Renderer {
     constexpr u32& max_bounces() { return max_bounces_; }
     constexpr u32 max_bounces() const { return max_bounces_; }
 
-    Image Render(const RenderObject& world) const {
+    // number of bounces after which paths start being terminated by russian roulette
+    constexpr u32& roulette_depth() { return roulette_depth_; }
+    constexpr u32 roulette_depth() const { return roulette_depth_; }
+
+    // lower bound on the probability of a path surviving russian roulette, so that dim paths
+    // don't get reweighted into fireflies
+    constexpr f64& roulette_min_survival() { return roulette_min_survival_; }
+    constexpr f64 roulette_min_survival() const { return roulette_min_survival_; }
+
+    // adaptive sampling: take samples until the 95% confidence interval of every channel of the
+    // pixel mean is narrower than +-adaptive_error, but at least adaptive_min_samples and at most
+    // adaptive_max_samples. Otherwise every pixel gets samples_per_pixel samples.
+    constexpr bool& adaptive() { return adaptive_; }
+    constexpr bool adaptive() const { return adaptive_; }
+
+    constexpr u32& adaptive_min_samples() { return adaptive_min_samples_; }
+    constexpr u32 adaptive_min_samples() const { return adaptive_min_samples_; }
+
+    constexpr u32& adaptive_max_samples() { return adaptive_max_samples_; }
+    constexpr u32 adaptive_max_samples() const { return adaptive_max_samples_; }
+
+    constexpr f64& adaptive_error() { return adaptive_error_; }
+    constexpr f64 adaptive_error() const { return adaptive_error_; }
+
+    // every pixel sample draws its random numbers from a Philox stream keyed by this seed, the
+    // pixel and the sample index, so the image doesn't depend on the thread count or schedule
+    constexpr u32& seed() { return seed_; }
+    constexpr u32 seed() const { return seed_; }
+
+    // sample the lights directly at diffuse bounces (next event estimation), combined with
+    // scattering by multiple importance sampling; otherwise lights are only found by scattering
+    constexpr bool& sample_lights() { return sample_lights_; }
+    constexpr bool sample_lights() const { return sample_lights_; }
+
+    // side length of the square tiles the image is split into for scheduling
+    constexpr u32& tile_size() { return tile_size_; }
+    constexpr u32 tile_size() const { return tile_size_; }
+
+    // diagnostic mode of `Render` and `RenderStreaming`: if set, every pixel of the image is what
+    // it cost to render by this metric instead of its colour (see heatmap.h)
+    constexpr std::optional<CostMetric>& cost_metric() { return cost_metric_; }
+    constexpr std::optional<CostMetric> cost_metric() const { return cost_metric_; }
+
+    // progress of the current (or last) render, safe to poll from any thread
+    const RenderProgress& progress() const { return progress_; }
+
+    // render the frame, adding what was counted during the render to `stats` if given
+    Image Render(const RenderObject& world, const MaterialTable& materials,
+                 RenderStats* stats = nullptr) const {
         Image img{camera_.image_width(), camera_.image_height()};
 
-        constexpr u32 kNumThreads = 16;
+        const Scene scene{world, materials};
 
-        std::atomic_uint32_t lines_done = 0;
+        auto tiles = MakeTiles(img.width(), img.height());
 
-        auto render_thread = [this, &world, &img, &lines_done](u32 thread) {
-            for (u32 j = thread; j < img.height(); j += kNumThreads) {
-                for (u32 i = 0; i < img.width(); i++) {
-                    Colour colour_sum{0.0, 0.0, 0.0};
+        std::vector<RenderStats> worker_stats(pool_->size());
 
-                    for (u32 num_sample = 0; num_sample < samples_per_pixel_; num_sample++) {
-                        auto ray = SampleRay(i, j);
+        progress_.Start(tiles.size());
 
-                        colour_sum += Cast(ray, world, max_bounces_);
-                    }
+        // hand every worker a contiguous run of tiles; it works through them front to back (in
+        // reading order) while idle workers steal from the other end
+        ThreadPool::TaskGroup render_tasks;
 
-                    img[i, j] = colour_sum / samples_per_pixel_;
-                }
+        const auto num_tiles = static_cast<u32>(tiles.size());
+        const u32 num_workers = pool_->size();
 
-                lines_done.fetch_add(1);
+        for (u32 worker = 0; worker < num_workers; worker++) {
+            u32 first = worker * num_tiles / num_workers;
+            u32 last = (worker + 1) * num_tiles / num_workers;
+
+            // the owner pops from the back, so push its run in reverse
+            for (u32 t = last; t > first; t--) {
+                pool_->Submit(render_tasks, worker, [&, tile = tiles[t - 1]] {
+                    RunTile(worker_stats, [&](RenderStats& tile_stats) {
+                        RenderTile(scene, img, tile, tile_stats);
+                    });
+                });
             }
+        }
+
+        pool_->Wait(render_tasks);
+
+        Finish(worker_stats, stats);
+
+        return img;
+    }
+
+    // number of bands (rows of tiles) `RenderStreaming` keeps in memory at once
+    constexpr u32& stream_window() { return stream_window_; }
+    constexpr u32 stream_window() const { return stream_window_; }
+
+    // render straight into `out` one band of tiles at a time, so memory use is bounded by
+    // `stream_window` bands regardless of the image size. Bands are rendered in parallel but
+    // written (and freed) strictly in file order.
+    void RenderStreaming(const RenderObject& world, const MaterialTable& materials,
+                         ImageStreamWriter& out, RenderStats* stats = nullptr) const {
+        assert(stream_window_ > 0);
+        assert(out.width() == camera_.image_width() && out.height() == camera_.image_height());
+
+        const u32 width = camera_.image_width();
+        const u32 height = camera_.image_height();
+
+        const u32 num_bands = (height + tile_size_ - 1) / tile_size_;
+        const u32 tiles_per_band = (width + tile_size_ - 1) / tile_size_;
+
+        const Scene scene{world, materials};
+
+        struct Band {
+            std::unique_ptr<Image> img;
+            ThreadPool::TaskGroup tasks;
+        };
+
+        // bands in flight, band k (in file order) lives in slot k % stream_window_
+        std::vector<Band> window(stream_window_);
+
+        std::vector<RenderStats> worker_stats(pool_->size());
+
+        progress_.Start(u64{num_bands} * tiles_per_band);
+
+        auto image_band = [&out, num_bands](u32 k) {
+            return out.bottom_up() ? num_bands - 1 - k : k;
         };
 
-        // render_thread(0);
+        auto start_band = [&](u32 k) {
+            u32 y0 = image_band(k) * tile_size_;
+            u32 y1 = std::min(y0 + tile_size_, height);
 
-        std::array<std::thread, kNumThreads> render_threads;
+            Band& band = window[k % stream_window_];
+            band.img = std::make_unique<Image>(width, y1 - y0);
 
-        for (u32 i = 0; i < kNumThreads; i++) {
-            render_threads[i] = std::thread{render_thread, i};
+            for (u32 x = 0; x < width; x += tile_size_) {
+                Tile tile{x, y0, std::min(x + tile_size_, width), y1};
+
+                pool_->Submit(band.tasks, [&, tile, y0] {
+                    RunTile(worker_stats, [&](RenderStats& tile_stats) {
+                        RenderTile(scene, *band.img, tile, tile_stats, y0);
+                    });
+                });
+            }
+        };
+
+        for (u32 k = 0; k < std::min(stream_window_, num_bands); k++) {
+            start_band(k);
         }
 
-        std::atomic_bool done = false;
+        for (u32 k = 0; k < num_bands; k++) {
+            Band& band = window[k % stream_window_];
+
+            pool_->Wait(band.tasks);
 
-        auto writer_thread = std::thread([&done, &lines_done, total_lines = img.height()] {
-            using std::literals::chrono_literals::operator""ms;
+            out.WriteBand(*band.img);
+            band.img.reset();
 
-            while (!done.load()) {
-                std::cerr << "\rWriting line " << lines_done.load() << " of " << total_lines
-                          << std::flush;
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            if (k + stream_window_ < num_bands) {
+                start_band(k + stream_window_);
             }
+        }
+
+        Finish(worker_stats, stats);
+    }
+
+    // samples added to every pixel per pass of `RenderProgressive`
+    constexpr u32& pass_samples() { return pass_samples_; }
+    constexpr u32 pass_samples() const { return pass_samples_; }
+
+    // minimum time between two checkpoints of `RenderProgressive`
+    constexpr std::chrono::seconds& checkpoint_interval() { return checkpoint_interval_; }
+    constexpr std::chrono::seconds checkpoint_interval() const { return checkpoint_interval_; }
+
+    // key of the checkpoints of `RenderProgressive` for the scene with fingerprint `scene`: it
+    // covers every setting that changes which samples are drawn or what they add up to
+    CheckpointKey ProgressiveKey(u64 scene) const {
+        Fingerprint settings;
+
+        settings.Add(scene)
+            .Add(samples_per_pixel_)
+            .Add(max_bounces_)
+            .Add(roulette_depth_)
+            .Add(roulette_min_survival_)
+            .Add(sample_lights_);
+
+        return CheckpointKey{.width = camera_.image_width(),
+                             .height = camera_.image_height(),
+                             .pass_samples = pass_samples_,
+                             .seed = seed_,
+                             .settings = settings.value()};
+    }
+
+    // render in passes of `pass_samples` samples per pixel until every pixel has
+    // `samples_per_pixel` samples, accumulating into `accum` and checkpointing it every
+    // `checkpoint_interval`. If `accum` holds an earlier, interrupted render, continue it; open
+    // it with our `ProgressiveKey` to make sure it is one of ours.
+    //
+    // each pixel's samples are drawn from a stream keyed by the pixel and its sample count, so a
+    // resumed render draws new samples instead of repeating the ones already accumulated.
+    Image RenderProgressive(const RenderObject& world, const MaterialTable& materials,
+                            AccumulationBuffer& accum, RenderStats* stats = nullptr) const {
+        assert(accum.width() == camera_.image_width() && accum.height() == camera_.image_height());
+        assert(accum.key().pass_samples == pass_samples_ && accum.key().seed == seed_);
+        assert(pass_samples_ > 0);
+
+        const u32 num_passes = (samples_per_pixel_ + pass_samples_ - 1) / pass_samples_;
+
+        const Scene scene{world, materials};
+
+        auto tiles = MakeTiles(accum.width(), accum.height());
+
+        auto last_checkpoint = std::chrono::steady_clock::now();
+
+        std::vector<RenderStats> worker_stats(pool_->size());
+
+        progress_.Start(u64{num_passes - std::min(accum.passes_done(), num_passes)} *
+                        tiles.size());
 
-            std::clog << "\rDone                                                " << newline;
-        });
+        for (u32 pass = accum.passes_done(); pass < num_passes; pass++) {
+            const u32 target = std::min((pass + 1) * pass_samples_, samples_per_pixel_);
 
-        for (auto& t : render_threads) {
-            t.join();
+            ThreadPool::TaskGroup pass_tasks;
+
+            for (const auto& tile : tiles) {
+                pool_->Submit(pass_tasks, [&, tile] {
+                    RunTile(worker_stats, [&](RenderStats& tile_stats) {
+                        AccumulateTile(scene, accum, tile, target, tile_stats);
+                    });
+                });
+            }
+
+            pool_->Wait(pass_tasks);
+
+            accum.passes_done(pass + 1);
+
+            auto now = std::chrono::steady_clock::now();
+
+            if (now - last_checkpoint >= checkpoint_interval_ || pass + 1 == num_passes) {
+                accum.Checkpoint();
+                last_checkpoint = now;
+            }
         }
 
-        done.store(true);
+        Finish(worker_stats, stats);
 
-        writer_thread.join();
+        // samples per pixel, including those taken before a restart
+        if (stats != nullptr) {
+            for (u32 j = 0; j < accum.height(); j++) {
+                for (u32 i = 0; i < accum.width(); i++) {
+                    stats->samples.Add(accum[i, j].samples);
+                }
+            }
+        }
 
-        return img;
+        return accum.Resolve();
     }
 
    private:
+    // what a render reads: the objects, their materials and the lights among them
+    struct Scene {
+        Scene(const RenderObject& world, const MaterialTable& materials)
+            : world{world}, materials{materials}, lights{world, materials} {}
+
+        const RenderObject& world;
+        const MaterialTable& materials;
+
+        LightList lights;
+    };
+
+    // pixels [x0, x1) x [y0, y1)
+    struct Tile {
+        u32 x0, y0;
+        u32 x1, y1;
+    };
+
+    // run `render_tile(stats)` on a worker, counting into that worker's stats, and advance the
+    // progress by the tile
+    template <typename F>
+    void RunTile(std::vector<RenderStats>& worker_stats, F&& render_tile) const {
+        assert(ThreadPool::CurrentWorker() < worker_stats.size());
+
+        RenderStats& stats = worker_stats[ThreadPool::CurrentWorker()];
+
+        const auto tests_before = IntersectionCounters::Local();
+        const u64 rays_before = stats.rays;
+
+        auto start = std::chrono::steady_clock::now();
+
+        render_tile(stats);
+
+        stats.AddTile(std::chrono::steady_clock::now() - start);
+        stats.AddIntersectionTests(tests_before);
+
+        progress_.Advance(1, stats.rays - rays_before);
+    }
+
+    // end the render, merging the workers' stats into `stats` if given
+    void Finish(const std::vector<RenderStats>& worker_stats, RenderStats* stats) const {
+        if (stats != nullptr) {
+            for (const auto& ws : worker_stats) {
+                stats->Merge(ws);
+            }
+        }
+
+        progress_.Finish();
+    }
+
+    std::vector<Tile> MakeTiles(u32 width, u32 height) const {
+        assert(tile_size_ > 0);
+
+        std::vector<Tile> tiles;
+
+        for (u32 y = 0; y < height; y += tile_size_) {
+            for (u32 x = 0; x < width; x += tile_size_) {
+                tiles.push_back(
+                    Tile{x, y, std::min(x + tile_size_, width), std::min(y + tile_size_, height)});
+            }
+        }
+
+        return tiles;
+    }
+
+    // render `tile` into `img`, whose first row is image row `row_offset`
+    void RenderTile(const Scene& scene, Image& img, Tile tile, RenderStats& stats,
+                    u32 row_offset = 0) const {
+        for (u32 j = tile.y0; j < tile.y1; j++) {
+            for (u32 i = tile.x0; i < tile.x1; i++) {
+                u32 num_samples = 0;
+
+                u64 cost_before = cost_metric_.has_value() ? CostCounter(*cost_metric_, stats) : 0;
+
+                Colour col = adaptive_
+                                 ? SamplePixelAdaptive(scene, i, j, num_samples, stats)
+                                 : SamplePixel(scene, i, j, num_samples, stats);
+
+                if (cost_metric_.has_value()) {
+                    auto cost = static_cast<f64>(CostCounter(*cost_metric_, stats) - cost_before);
+                    col = Colour{cost, cost, cost};
+                }
+
+                img[i, j - row_offset] = col;
+
+                stats.samples.Add(num_samples);
+            }
+        }
+    }
+
+    Colour SamplePixel(const Scene& scene, u32 i, u32 j, u32& num_samples,
+                       RenderStats& stats) const {
+        Colour colour_sum{0.0, 0.0, 0.0};
+
+        for (num_samples = 0; num_samples < samples_per_pixel_; num_samples++) {
+            colour_sum += SamplePath(scene, i, j, num_samples, stats);
+        }
+
+        return colour_sum / samples_per_pixel_;
+    }
+
+    // sample until the confidence interval of the mean is tight enough, tracking mean and
+    // variance per channel with Welford's algorithm
+    Colour SamplePixelAdaptive(const Scene& scene, u32 i, u32 j, u32& num_samples,
+                               RenderStats& stats) const {
+        assert(0 < adaptive_min_samples_ && adaptive_min_samples_ <= adaptive_max_samples_);
+
+        // two-sided 95% quantile of the normal distribution
+        constexpr f64 kZ = 1.96;
+
+        std::array<f64, 3> mean{};
+        std::array<f64, 3> m2{};  // sum of squared deviations from the mean
+
+        for (num_samples = 1; num_samples <= adaptive_max_samples_; num_samples++) {
+            Colour sample = SamplePath(scene, i, j, num_samples - 1, stats);
+
+            std::array<f64, 3> x{sample.r(), sample.g(), sample.b()};
+
+            for (u32 c = 0; c < 3; c++) {
+                f64 delta = x[c] - mean[c];
+                mean[c] += delta / num_samples;
+                m2[c] += delta * (x[c] - mean[c]);
+            }
+
+            if (num_samples < adaptive_min_samples_ || num_samples < 2) {
+                continue;
+            }
+
+            // half width of the confidence interval is z * sqrt(var / n), var = m2 / (n - 1)
+            f64 max_error2 = (adaptive_error_ * adaptive_error_) / (kZ * kZ);
+
+            auto n = static_cast<f64>(num_samples);
+
+            if (std::ranges::all_of(m2, [=](f64 m) { return m / ((n - 1) * n) <= max_error2; })) {
+                break;
+            }
+        }
+
+        num_samples = std::min(num_samples, adaptive_max_samples_);
+
+        return Colour{mean[0], mean[1], mean[2]};
+    }
+
+    // add samples to every pixel of `tile` until it has `target` samples
+    void AccumulateTile(const Scene& scene, AccumulationBuffer& accum, Tile tile, u32 target,
+                        RenderStats& stats) const {
+        for (u32 j = tile.y0; j < tile.y1; j++) {
+            for (u32 i = tile.x0; i < tile.x1; i++) {
+                AccumulationBuffer::Pixel px = accum[i, j];
+
+                if (px.samples >= target) {
+                    // already done before a restart
+                    continue;
+                }
+
+                // samples are keyed by their index, so a resumed pixel continues exactly where it
+                // left off
+                for (; px.samples < target; px.samples++) {
+                    px.sum += SamplePath(scene, i, j, px.samples, stats);
+                }
+
+                // single store of the updated pixel
+                accum[i, j] = px;
+            }
+        }
+    }
+
+    // trace sample `sample` of pixel (i, j) on its own random stream
+    Colour SamplePath(const Scene& scene, u32 i, u32 j, u32 sample, RenderStats& stats) const {
+        RandomGen::GenInstance().StartSample(seed_, j * camera_.image_width() + i, sample);
+
+        return Cast(SampleRay(i, j), scene, stats);
+    }
+
     Ray SampleRay(u32 i, u32 j) const {
         auto& rand = RandomGen::GenInstance();
 
@@ -110,39 +488,195 @@ class Renderer {
         return Ray{ray_origin, ray_direction};
     }
 
-    constexpr Colour Cast(const Ray& ray, const RenderObject& world, u32 bounces) const {
-        auto hit_record = world.hit(ray, Interval{0.001, kInf});
+    // trace a path starting with `ray`, tracking the product of albedos along the path as its
+    // throughput. After `roulette_depth_` bounces, paths are terminated with probability
+    // 1 - max(throughput) and survivors reweighted, which keeps the estimate unbiased.
+    //
+    // with `sample_lights_`, every diffuse bounce also samples a light directly. Light found that
+    // way and light found by scattering into an emitter are weighted against each other by
+    // multiple importance sampling, so each comes from the strategy that finds it more easily.
+    constexpr Colour Cast(Ray ray, const Scene& scene, RenderStats& stats) const {
+        Colour radiance = Colour::kBlack;
+        Colour throughput = Colour::kWhite;
+
+        const bool sample_lights = sample_lights_ && !scene.lights.empty();
+
+        // density with which the last bounce scattered into `ray` if it sampled a light too, 0
+        // if it didn't (or `ray` is the camera ray), in which case emitters count in full. The
+        // normal there is needed for the probability of having picked the light `ray` finds.
+        f64 scatter_pdf = 0.0;
+        Vec3 scatter_normal;
+
+        for (u32 bounces = 0;; bounces++) {
+            stats.rays++;
+
+            Intersection isect;
+
+            // background
+            if (!scene.world.intersect(ray, Interval{kSelfIntersectEps<f64>, kInf}, isect)) {
+                stats.paths_escaped++;
+                stats.AddPath(bounces);
+
+                auto unit_dir = ray.direction();
+
+                f64 a = 0.5 * (unit_dir.y() + 1.0);
+
+                return radiance +
+                       throughput * ((1.0 - a) * Colour{1.0, 1.0, 1.0} + a * Colour{0.5, 0.7, 1.0});
+            }
+
+            // hit
+
+            HitRecord hit_record = RenderObject::SurfaceAt(ray, isect);
+
+            if (scene.materials.IsEmissive(hit_record.mat)) {
+                f64 weight =
+                    scatter_pdf > 0.0
+                        ? EmitterWeight(scene, ray, scatter_normal, isect, hit_record, scatter_pdf)
+                        : 1.0;
+
+                radiance += weight * throughput * scene.materials.Emission(hit_record.mat);
+            }
+
+            if (bounces == max_bounces_) {
+                stats.paths_max_depth++;
+                stats.AddPath(bounces);
+
+                return radiance;
+            }
+
+            // bounce 0 is the camera ray
+            RandomGen::GenInstance().StartBounce(bounces + 1);
+
+            const bool diffuse = sample_lights && scene.materials.IsDiffuse(hit_record.mat);
+
+            if (diffuse) {
+                radiance += throughput * SampleLight(scene, hit_record, stats);
+            }
+
+            auto res = scene.materials.Scatter(ray, hit_record);
+
+            if (!res.has_value()) {
+                // absorped
+                stats.paths_absorbed++;
+                stats.AddPath(bounces);
+
+                return radiance;
+            }
+
+            auto [albedo, out_ray] = res.value();
+
+            scatter_pdf =
+                diffuse ? scene.materials.Evaluate(hit_record, out_ray.direction()).pdf : 0.0;
+            scatter_normal = hit_record.normal;
+
+            throughput *= albedo;
+            ray = out_ray;
+
+            if (bounces + 1 >= roulette_depth_) {
+                f64 survival = std::clamp(throughput.max_component(), roulette_min_survival_, 1.0);
+
+                if (RandomGen::GenInstance().Uniform() >= survival) {
+                    stats.paths_roulette++;
+                    stats.AddPath(bounces + 1);
+
+                    return radiance;
+                }
+
+                throughput = throughput / survival;
+            }
+        }
+    }
+
+    // next event estimation: light arriving at `hit_record` straight from a point sampled on one
+    // of the lights, weighted against finding it by scattering
+    Colour SampleLight(const Scene& scene, const HitRecord& hit_record, RenderStats& stats) const {
+        auto& rand = RandomGen::GenInstance();
+
+        auto choice = scene.lights.Choose(hit_record.p, hit_record.normal, rand.Uniform());
+
+        f64 u1 = rand.Uniform();
+        f64 u2 = rand.Uniform();
+
+        if (!choice.has_value()) {
+            // no light reaches this point
+            return Colour::kBlack;
+        }
 
-        // background
-        if (!hit_record.has_value()) {
-            auto unit_dir = ray.direction();
+        auto [light, choose_prob] = choice.value();
 
-            f64 a = 0.5 * (unit_dir.y() + 1.0);
+        auto sample = scene.lights[light].Sample(hit_record.p, u1, u2);
 
-            return (1.0 - a) * Colour{1.0, 1.0, 1.0} + a * Colour{0.5, 0.7, 1.0};
+        if (!sample.has_value()) {
+            return Colour::kBlack;
         }
 
-        // hit
+        auto eval = scene.materials.Evaluate(hit_record, sample->dir);
 
-        if (bounces == 0) {
+        if (eval.f_cos.max_component() <= 0.0) {
+            // below the surface, don't bother with the shadow ray
             return Colour::kBlack;
         }
 
-        auto res = hit_record->mat->Scatter(ray, hit_record.value());
+        stats.shadow_rays++;
+
+        Ray shadow_ray{hit_record.p, sample->dir};
+        Interval ts{kSelfIntersectEps<f64>, sample->dist - kSelfIntersectEps<f64>};
 
-        if (!res.has_value()) {
-            // absorped
+        if (scene.world.occluded(shadow_ray, ts)) {
             return Colour::kBlack;
         }
 
-        auto [albedo, out_ray] = res.value();
+        f64 light_pdf = choose_prob * sample->pdf;
 
-        assert(bounces > 0);
-        return albedo * Cast(out_ray, world, bounces - 1);
+        return (PowerHeuristic(light_pdf, eval.pdf) / light_pdf) * eval.f_cos * sample->emission;
+    }
+
+    // weight of the light from an emitter hit by `ray` at `isect`, which a diffuse bounce on a
+    // surface with normal `normal` scattered into with density `scatter_pdf` after sampling a light
+    // itself
+    static f64 EmitterWeight(const Scene& scene, const Ray& ray, Vec3 normal,
+                             const Intersection& isect, const HitRecord& hit_record,
+                             f64 scatter_pdf) {
+        auto light = scene.lights.FromHit(isect);
+
+        if (!light.has_value()) {
+            // an emitter lights are never sampled from, scattering is the only way to find it
+            return 1.0;
+        }
+
+        f64 light_pdf = scene.lights.ChooseProbability(ray.origin(), normal, *light) *
+                        scene.lights[*light].Pdf(ray.origin(), ray.direction(), hit_record);
+
+        return PowerHeuristic(scatter_pdf, light_pdf);
     }
 
     Camera camera_;
 
+    ThreadPool* pool_;
+
+    mutable RenderProgress progress_;
+
     u32 samples_per_pixel_;
     u32 max_bounces_;
+
+    u32 roulette_depth_ = 3;
+    f64 roulette_min_survival_ = 0.05;
+
+    bool adaptive_ = false;
+    u32 adaptive_min_samples_ = 16;
+    u32 adaptive_max_samples_ = 1024;
+    f64 adaptive_error_ = 0.01;
+
+    u32 seed_ = 0;
+
+    bool sample_lights_ = true;
+
+    std::optional<CostMetric> cost_metric_;
+
+    u32 tile_size_ = 16;
+    u32 stream_window_ = 4;
+
+    u32 pass_samples_ = 4;
+    std::chrono::seconds checkpoint_interval_{60};
 };
@@ -1,24 +1,48 @@
 #pragma once
 
+#include <array>
+#include <cassert>
+#include <concepts>
 #include <memory>
 #include <optional>
 
+#include "aabb.h"
 #include "interval.h"
 #include "ray.h"
 #include "raytracer.h"
 #include "vec3.h"
 
-class Material;
+// index into the scene's MaterialTable
+using MaterialId = u32;
 
-struct HitRecord {
-    Point3 p;
-    Vec3 normal;
-    const Material* mat = nullptr;
+template <std::floating_point T>
+struct BasicHitRecord {
+    BasicVec3<T> p;
+    BasicVec3<T> normal;
+    MaterialId mat = 0;
 
-    f64 t = kNan;
+    T t = kNanOf<T>;
     bool front_face = true;
 };
 
+using HitRecord = BasicHitRecord<f64>;
+using HitRecordf = BasicHitRecord<f32>;
+
+class LightList;
+class RenderObject;
+
+// closest hit found by `RenderObject::intersect`: just enough to tell where it is, the surface
+// there is only worked out for the final hit of a ray
+struct Intersection {
+    f64 t = kInf;
+
+    const RenderObject* obj = nullptr;       // primitive hit
+    const RenderObject* instance = nullptr;  // `Instance` it was hit through, if any
+
+    u32 prim = 0;               // part of `obj` hit, e.g. the triangle of a mesh
+    std::array<f64, 3> bary{};  // weights of the vertices of a triangle at the hit
+};
+
 class RenderObject {
    public:
     RenderObject() = default;
@@ -31,7 +55,51 @@ class RenderObject {
 
     virtual ~RenderObject() = default;
 
-    virtual std::optional<HitRecord> hit(const Ray& ray, Interval ts) const = 0;
+    // closest hit in `ts`, found in two steps: `intersect` and then `interaction` with what it
+    // found
+    std::optional<HitRecord> hit(const Ray& ray, Interval ts) const {
+        Intersection isect;
+
+        if (!intersect(ray, ts, isect)) {
+            return std::nullopt;
+        }
+
+        return SurfaceAt(ray, isect);
+    }
+
+    // the surface at `isect`, as stored by the `intersect` of any object
+    static HitRecord SurfaceAt(const Ray& ray, const Intersection& isect) {
+        assert(isect.obj != nullptr);
+
+        const RenderObject* surface = isect.instance != nullptr ? isect.instance : isect.obj;
+
+        return surface->interaction(ray, isect);
+    }
+
+    // if the ray hits us in `ts`, store the closest hit in `isect` and return true. Aggregates
+    // pass on what their children store, so `isect.obj` is always a primitive.
+    virtual bool intersect(const Ray& ray, Interval ts, Intersection& isect) const = 0;
+
+    // the surface at `isect`, which our own `intersect` stored. Never called on aggregates.
+    virtual HitRecord interaction(const Ray& /* ray */, const Intersection& /* isect */) const {
+        assert(false);
+
+        return {};
+    }
+
+    // whether the ray hits anything in `ts` at all, e.g. for shadow rays. Overrides stop at the
+    // first hit they find.
+    virtual bool occluded(const Ray& ray, Interval ts) const {
+        Intersection isect;
+
+        return intersect(ray, ts, isect);
+    }
+
+    // axis-aligned box enclosing everything `hit` can ever return
+    virtual AABB bounds() const = 0;
+
+    // add the primitives that emit light to `lights`, see lights.h
+    virtual void AddLights(LightList& /* lights */) const {}
 };
 
 using SharedRenderObject = std::shared_ptr<RenderObject>;
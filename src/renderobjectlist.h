@@ -1,50 +1,102 @@
 #pragma once
 
-#include <initializer_list>
+#include <concepts>
+#include <cstddef>
 #include <memory>
-#include <optional>
 #include <utility>
 #include <vector>
 
+#include "aabb.h"
 #include "interval.h"
 #include "ray.h"
 #include "raytracer.h"
 #include "renderobject.h"
+#include "scenearena.h"
 
+// the objects of a scene, in the order they were added
+//
+// objects made with `Emplace` live in the list's `SceneArena`, next to the others of their type;
+// `Add` takes objects that were allocated elsewhere.
 class RenderObjectList : public RenderObject {
    public:
     constexpr RenderObjectList() = default;
     // explicit RenderObjectList(const SharedRenderObject& obj) { Append(obj); }
     // RenderObjectList(std::initializer_list<RenderObject> objs) : objs_{objs} {}
 
-    constexpr auto begin() { return objs_.begin(); }
-    constexpr auto end() { return objs_.end(); }
-
     constexpr auto begin() const { return objs_.begin(); }
     constexpr auto end() const { return objs_.end(); }
 
-    void Add(std::unique_ptr<RenderObject> obj) { objs_.emplace_back(std::move(obj)); }
+    const RenderObject& operator[](std::size_t i) const { return *objs_[i]; }
+
+    template <std::derived_from<RenderObject> T, typename... Args>
+    T& Emplace(Args&&... args) {
+        if (arena_ == nullptr) {
+            arena_ = std::make_unique<SceneArena>();
+        }
+
+        T& obj = arena_->Make<T>(std::forward<Args>(args)...);
+        objs_.push_back(&obj);
+
+        return obj;
+    }
+
+    void Add(std::unique_ptr<RenderObject> obj) {
+        objs_.push_back(obj.get());
+        owned_.push_back(std::move(obj));
+    }
 
-    void Clear() { objs_.clear(); }
+    void Clear() {
+        objs_.clear();
+        owned_.clear();
+        arena_.reset();
+    }
 
-    std::optional<HitRecord> hit(const Ray& ray, Interval ts) const override {
-        std::optional<HitRecord> closest_hit_record = std::nullopt;
+    bool intersect(const Ray& ray, Interval ts, Intersection& isect) const override {
+        bool found = false;
 
         f64 closest_t = ts.max();
 
-        for (const auto& obj : objs_) {
-            Interval _ts{ts.min(), closest_t};
-            auto hit_record = obj->hit(ray, _ts);
+        for (const auto* obj : objs_) {
+            if (obj->intersect(ray, Interval{ts.min(), closest_t}, isect)) {
+                found = true;
+                closest_t = isect.t;
+            }
+        }
 
-            if (hit_record.has_value()) {
-                closest_hit_record = hit_record;
-                closest_t = hit_record->t;
+        return found;
+    }
+
+    bool occluded(const Ray& ray, Interval ts) const override {
+        for (const auto* obj : objs_) {
+            if (obj->occluded(ray, ts)) {
+                return true;
             }
         }
 
-        return closest_hit_record;
+        return false;
+    }
+
+    AABB bounds() const override {
+        AABB box;
+
+        for (const auto* obj : objs_) {
+            box.Extend(obj->bounds());
+        }
+
+        return box;
     }
 
+    void AddLights(LightList& lights) const override {
+        for (const auto* obj : objs_) {
+            obj->AddLights(lights);
+        }
+    }
+
+    std::size_t size() const { return objs_.size(); }
+
    private:
-    std::vector<std::unique_ptr<RenderObject>> objs_;
+    std::vector<const RenderObject*> objs_;
+
+    std::unique_ptr<SceneArena> arena_;
+    std::vector<std::unique_ptr<RenderObject>> owned_;
 };
@@ -0,0 +1,317 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+#include <string_view>
+
+#include "raytracer.h"
+
+// render telemetry: counters every worker keeps for itself and that are merged at the end of a
+// render, and the progress of a running render, which can be polled from any thread
+
+enum class PrimitiveKind : u32 {
+    kBox,  // BVH node bounds
+    kSphere,
+    kPackedSphere,  // spheres tested by `PackedSpheres`, one per sphere and ray
+    kRectangle,
+    kTriangle,
+    kInstance,  // rays taken into the object space of an `Instance`
+};
+
+constexpr u32 kNumPrimitiveKinds = 6;
+
+constexpr std::string_view PrimitiveName(PrimitiveKind kind) {
+    constexpr std::array<std::string_view, kNumPrimitiveKinds> names{
+        "box", "sphere", "packed sphere", "rectangle", "triangle", "instance"};
+
+    return names[static_cast<u32>(kind)];
+}
+
+// intersection tests done by the calling thread, counted by the `intersect` and `occluded` of
+// every primitive. It is a plain thread local array, so counting costs one increment; the renderer
+// reads it before and after every tile.
+class IntersectionCounters {
+   public:
+    using Counts = std::array<u64, kNumPrimitiveKinds>;
+
+    static void Count(PrimitiveKind kind, u64 n = 1) {
+        counts_[static_cast<u32>(kind)] += n;
+    }
+
+    static const Counts& Local() { return counts_; }
+
+   private:
+    static inline thread_local constinit Counts counts_{};
+};
+
+// distribution of the number of samples taken per pixel
+struct SampleStats {
+    static constexpr u32 kNumBuckets = 32;
+
+    u64 num_pixels = 0;
+    u64 num_samples = 0;
+
+    u32 min_samples = std::numeric_limits<u32>::max();
+    u32 max_samples = 0;
+
+    // histogram[b] counts the pixels that took [2^b, 2^(b+1)) samples
+    std::array<u64, kNumBuckets> histogram{};
+
+    constexpr void Add(u32 samples) {
+        assert(samples > 0);
+
+        num_pixels++;
+        num_samples += samples;
+
+        min_samples = std::min(min_samples, samples);
+        max_samples = std::max(max_samples, samples);
+
+        histogram[std::bit_width(samples) - 1]++;
+    }
+
+    constexpr void Merge(const SampleStats& other) {
+        num_pixels += other.num_pixels;
+        num_samples += other.num_samples;
+
+        min_samples = std::min(min_samples, other.min_samples);
+        max_samples = std::max(max_samples, other.max_samples);
+
+        for (u32 b = 0; b < kNumBuckets; b++) {
+            histogram[b] += other.histogram[b];
+        }
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const SampleStats& stats) {
+    if (stats.num_pixels == 0) {
+        return os << "no pixels sampled";
+    }
+
+    const auto num_pixels = static_cast<f64>(stats.num_pixels);
+
+    os << "samples per pixel: mean " << static_cast<f64>(stats.num_samples) / num_pixels << ", min "
+       << stats.min_samples << ", max " << stats.max_samples;
+
+    for (u32 b = 0; b < SampleStats::kNumBuckets; b++) {
+        if (stats.histogram[b] == 0) {
+            continue;
+        }
+
+        os << newline << "  [" << (u64{1} << b) << ", " << (u64{1} << (b + 1))
+           << "): " << std::setw(10) << stats.histogram[b] << " pixels ("
+           << 100.0 * static_cast<f64>(stats.histogram[b]) / num_pixels << "%)";
+    }
+
+    return os;
+}
+
+// everything counted during a render. Every worker fills its own copy, which are merged when the
+// render is done.
+struct alignas(64) RenderStats {
+    // paths longer than this are counted in the last bucket of the depth histogram
+    static constexpr u32 kMaxDepth = 64;
+
+    // camera rays and scattered rays, i.e. closest hit queries on the scene
+    u64 rays = 0;
+
+    // shadow rays towards sampled lights, which aren't counted in `rays`
+    u64 shadow_rays = 0;
+
+    IntersectionCounters::Counts intersection_tests{};
+
+    // depth_histogram[d] counts the paths that ended after d bounces
+    std::array<u64, kMaxDepth> depth_histogram{};
+
+    // how paths ended
+    u64 paths_escaped = 0;    // left the scene
+    u64 paths_absorbed = 0;   // absorbed by a material
+    u64 paths_roulette = 0;   // terminated by russian roulette
+    u64 paths_max_depth = 0;  // reached the bounce limit
+
+    SampleStats samples;
+
+    // time spent on tiles by all workers together
+    u64 num_tiles = 0;
+    std::chrono::nanoseconds tile_time{};
+    std::chrono::nanoseconds min_tile_time = std::chrono::nanoseconds::max();
+    std::chrono::nanoseconds max_tile_time{};
+
+    constexpr u64 num_paths() const {
+        return paths_escaped + paths_absorbed + paths_roulette + paths_max_depth;
+    }
+
+    constexpr void AddPath(u32 depth) { depth_histogram[std::min(depth, kMaxDepth - 1)]++; }
+
+    constexpr void AddTile(std::chrono::nanoseconds time) {
+        num_tiles++;
+        tile_time += time;
+
+        min_tile_time = std::min(min_tile_time, time);
+        max_tile_time = std::max(max_tile_time, time);
+    }
+
+    // add the intersection tests counted by this thread between `before` and now
+    void AddIntersectionTests(const IntersectionCounters::Counts& before) {
+        const auto& now = IntersectionCounters::Local();
+
+        for (u32 k = 0; k < kNumPrimitiveKinds; k++) {
+            intersection_tests[k] += now[k] - before[k];
+        }
+    }
+
+    constexpr void Merge(const RenderStats& other) {
+        rays += other.rays;
+        shadow_rays += other.shadow_rays;
+
+        for (u32 k = 0; k < kNumPrimitiveKinds; k++) {
+            intersection_tests[k] += other.intersection_tests[k];
+        }
+
+        for (u32 d = 0; d < kMaxDepth; d++) {
+            depth_histogram[d] += other.depth_histogram[d];
+        }
+
+        paths_escaped += other.paths_escaped;
+        paths_absorbed += other.paths_absorbed;
+        paths_roulette += other.paths_roulette;
+        paths_max_depth += other.paths_max_depth;
+
+        samples.Merge(other.samples);
+
+        num_tiles += other.num_tiles;
+        tile_time += other.tile_time;
+        min_tile_time = std::min(min_tile_time, other.min_tile_time);
+        max_tile_time = std::max(max_tile_time, other.max_tile_time);
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const RenderStats& stats) {
+    // the intersection tests include those of shadow rays
+    auto per_ray = [queries = stats.rays + stats.shadow_rays](u64 n) {
+        return queries == 0 ? 0.0 : static_cast<f64>(n) / static_cast<f64>(queries);
+    };
+
+    auto percent = [](u64 n, u64 total) {
+        return total == 0 ? 0.0 : 100.0 * static_cast<f64>(n) / static_cast<f64>(total);
+    };
+
+    os << "rays: " << stats.rays << ", shadow rays: " << stats.shadow_rays << newline;
+
+    os << "intersection tests per ray:";
+
+    for (u32 k = 0; k < kNumPrimitiveKinds; k++) {
+        if (stats.intersection_tests[k] > 0) {
+            os << ' ' << PrimitiveName(static_cast<PrimitiveKind>(k)) << ' '
+               << per_ray(stats.intersection_tests[k]);
+        }
+    }
+
+    const u64 paths = stats.num_paths();
+
+    os << newline << "paths: " << paths << ", escaped " << percent(stats.paths_escaped, paths)
+       << "%, absorbed " << percent(stats.paths_absorbed, paths) << "%, roulette "
+       << percent(stats.paths_roulette, paths) << "%, max depth "
+       << percent(stats.paths_max_depth, paths) << '%' << newline;
+
+    os << "path depth:";
+
+    for (u32 d = 0; d < RenderStats::kMaxDepth; d++) {
+        if (stats.depth_histogram[d] > 0) {
+            const char* more = d + 1 == RenderStats::kMaxDepth ? "+" : "";
+
+            os << newline << "  " << std::setw(2) << d << more << ": " << std::setw(10)
+               << stats.depth_histogram[d] << " (" << percent(stats.depth_histogram[d], paths)
+               << "%)";
+        }
+    }
+
+    os << newline << stats.samples << newline;
+
+    if (stats.num_tiles > 0) {
+        using ms = std::chrono::duration<f64, std::milli>;
+
+        os << "tiles: " << stats.num_tiles << ", mean "
+           << ms(stats.tile_time).count() / static_cast<f64>(stats.num_tiles) << " ms, min "
+           << ms(stats.min_tile_time).count() << " ms, max " << ms(stats.max_tile_time).count()
+           << " ms";
+    }
+
+    return os;
+}
+
+// progress of a render, advanced by the workers once per tile. All fields are atomics, so it can
+// be polled from any thread while the render runs without locking or slowing the workers down.
+class RenderProgress {
+   public:
+    struct Snapshot {
+        u64 work_done = 0;  // tiles, or tile passes of a progressive render
+        u64 work_total = 0;
+        u64 rays = 0;
+
+        std::chrono::nanoseconds elapsed{};
+
+        bool running = false;
+
+        constexpr f64 fraction() const {
+            return work_total == 0 ? 0.0
+                                   : static_cast<f64>(work_done) / static_cast<f64>(work_total);
+        }
+    };
+
+    Snapshot Poll() const {
+        Snapshot snapshot;
+
+        snapshot.work_done = work_done_.load(std::memory_order_relaxed);
+        snapshot.work_total = work_total_.load(std::memory_order_relaxed);
+        snapshot.rays = rays_.load(std::memory_order_relaxed);
+        snapshot.running = running_.load(std::memory_order_relaxed);
+
+        auto start = Clock::time_point{Clock::duration{start_.load(std::memory_order_relaxed)}};
+        auto end = snapshot.running
+                       ? Clock::now()
+                       : Clock::time_point{Clock::duration{end_.load(std::memory_order_relaxed)}};
+
+        snapshot.elapsed = end - start;
+
+        return snapshot;
+    }
+
+    // called by the renderer
+
+    void Start(u64 work_total) {
+        work_done_.store(0, std::memory_order_relaxed);
+        work_total_.store(work_total, std::memory_order_relaxed);
+        rays_.store(0, std::memory_order_relaxed);
+        start_.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        running_.store(true, std::memory_order_relaxed);
+    }
+
+    void Advance(u64 work, u64 rays) {
+        work_done_.fetch_add(work, std::memory_order_relaxed);
+        rays_.fetch_add(rays, std::memory_order_relaxed);
+    }
+
+    void Finish() {
+        end_.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        running_.store(false, std::memory_order_relaxed);
+    }
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    std::atomic_uint64_t work_done_ = 0;
+    std::atomic_uint64_t work_total_ = 0;
+    std::atomic_uint64_t rays_ = 0;
+
+    std::atomic<Clock::rep> start_ = 0;
+    std::atomic<Clock::rep> end_ = 0;
+
+    std::atomic_bool running_ = false;
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "raytracer.h"
+
+// storage for the objects of a scene
+//
+// objects of one type are packed next to each other, in blocks that double in size as the scene
+// grows, and all blocks come out of one monotonic buffer. Building a scene of a million spheres
+// costs a few dozen allocations instead of a million, and tearing it down runs the destructors
+// and releases the buffer in one go.
+class SceneArena {
+   public:
+    SceneArena() = default;
+
+    // the objects are referred to by address
+    SceneArena(const SceneArena&) = delete;
+    SceneArena& operator=(const SceneArena&) = delete;
+
+    SceneArena(SceneArena&&) = delete;
+    SceneArena& operator=(SceneArena&&) = delete;
+
+    ~SceneArena() {
+        // the memory goes with `resource_`
+        for (auto it = pools_.rbegin(); it != pools_.rend(); ++it) {
+            std::destroy_at(it->pool);
+        }
+    }
+
+    // construct a T, which lives as long as the arena
+    template <typename T, typename... Args>
+    T& Make(Args&&... args) {
+        return GetPool<T>().Emplace(std::forward<Args>(args)...);
+    }
+
+   private:
+    class PoolBase {
+       public:
+        PoolBase() = default;
+
+        PoolBase(const PoolBase&) = delete;
+        PoolBase& operator=(const PoolBase&) = delete;
+
+        PoolBase(PoolBase&&) = delete;
+        PoolBase& operator=(PoolBase&&) = delete;
+
+        virtual ~PoolBase() = default;
+    };
+
+    // the objects of type T
+    template <typename T>
+    class Pool : public PoolBase {
+       public:
+        explicit Pool(std::pmr::memory_resource& resource) : resource_{resource} {}
+
+        Pool(const Pool&) = delete;
+        Pool& operator=(const Pool&) = delete;
+
+        Pool(Pool&&) = delete;
+        Pool& operator=(Pool&&) = delete;
+
+        ~Pool() override {
+            if constexpr (!std::is_trivially_destructible_v<T>) {
+                for (const auto& block : blocks_) {
+                    std::destroy_n(block.objs, block.size);
+                }
+            }
+        }
+
+        template <typename... Args>
+        T& Emplace(Args&&... args) {
+            if (blocks_.empty() || blocks_.back().size == blocks_.back().capacity) {
+                std::size_t capacity =
+                    blocks_.empty() ? kFirstBlockSize : 2 * blocks_.back().capacity;
+
+                void* storage = resource_.allocate(capacity * sizeof(T), alignof(T));
+                blocks_.push_back(Block{static_cast<T*>(storage), 0, capacity});
+            }
+
+            Block& block = blocks_.back();
+
+            T* obj = std::construct_at(block.objs + block.size, std::forward<Args>(args)...);
+            block.size++;
+
+            return *obj;
+        }
+
+       private:
+        // about a page worth of small objects
+        static constexpr std::size_t kFirstBlockSize = std::max<std::size_t>(4096 / sizeof(T), 1);
+
+        struct Block {
+            T* objs;
+            std::size_t size;
+            std::size_t capacity;
+        };
+
+        std::pmr::memory_resource& resource_;
+
+        std::vector<Block> blocks_;
+    };
+
+    // one address per type, to find its pool by
+    template <typename T>
+    static constexpr char kTypeTag = 0;
+
+    struct TaggedPool {
+        const void* tag;
+        PoolBase* pool;
+    };
+
+    // scenes have a handful of types, so a linear search is as fast as anything
+    template <typename T>
+    Pool<T>& GetPool() {
+        for (const auto& [tag, pool] : pools_) {
+            if (tag == &kTypeTag<T>) {
+                return static_cast<Pool<T>&>(*pool);
+            }
+        }
+
+        void* storage = resource_.allocate(sizeof(Pool<T>), alignof(Pool<T>));
+        Pool<T>* pool = std::construct_at(static_cast<Pool<T>*>(storage), resource_);
+
+        pools_.push_back(TaggedPool{&kTypeTag<T>, pool});
+
+        return *pool;
+    }
+
+    std::pmr::monotonic_buffer_resource resource_;
+
+    std::vector<TaggedPool> pools_;
+};
@@ -0,0 +1,214 @@
+// convert a text scene description into the binary scene format read by `ray-tracer --scene`
+//
+// one statement per line, `#` starts a comment:
+//
+//   image WIDTH HEIGHT
+//   centre X Y Z
+//   look_at X Y Z
+//   up X Y Z
+//   fov DEGREES
+//   focal_length F
+//   defocus_angle DEGREES
+//   material NAME lambertian R G B
+//   material NAME metal R G B FUZZ
+//   material NAME dielectric ETA FUZZ
+//   material NAME light R G B
+//   sphere X Y Z RADIUS MATERIAL
+//   rectangle X Y Z AX AY AZ BX BY BZ MATERIAL
+//
+// materials have to be defined before they are used
+
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include "raytracer.h"
+#include "scenefile.h"
+#include "vec3.h"
+
+namespace {
+
+class ParseError {
+   public:
+    explicit ParseError(std::string what) : what_{std::move(what)} {}
+
+    const std::string& what() const { return what_; }
+
+   private:
+    std::string what_;
+};
+
+template <typename T>
+T Read(std::istringstream& line, std::string_view what) {
+    T value{};
+
+    if (!(line >> value)) {
+        throw ParseError{"expected " + std::string{what}};
+    }
+
+    return value;
+}
+
+std::array<f64, 3> ReadVec(std::istringstream& line) {
+    auto x = Read<f64>(line, "x");
+    auto y = Read<f64>(line, "y");
+    auto z = Read<f64>(line, "z");
+
+    return {x, y, z};
+}
+
+void Parse(std::istream& in, SceneBuilder& scene) {
+    std::unordered_map<std::string, MaterialId> material_ids;
+
+    auto material = [&material_ids](std::istringstream& line) {
+        auto name = Read<std::string>(line, "material name");
+        auto it = material_ids.find(name);
+
+        if (it == material_ids.end()) {
+            throw ParseError{"unknown material " + name};
+        }
+
+        return it->second;
+    };
+
+    CameraRecord& camera = scene.camera();
+
+    // same defaults as `Camera`
+    camera.centre = {0, 0, -1};
+    camera.look_at = {0, 0, 0};
+    camera.up = {0, 1, 0};
+    camera.fov = 80;
+    camera.focal_length = 1;
+    camera.defocus_angle = 0;
+
+    std::string text;
+
+    for (u32 line_no = 1; std::getline(in, text); line_no++) {
+        text = text.substr(0, text.find('#'));
+
+        std::istringstream line{text};
+        std::string keyword;
+
+        if (!(line >> keyword)) {
+            continue;
+        }
+
+        try {
+            if (keyword == "image") {
+                camera.image_width = Read<u32>(line, "width");
+                camera.image_height = Read<u32>(line, "height");
+            } else if (keyword == "centre") {
+                camera.centre = ReadVec(line);
+            } else if (keyword == "look_at") {
+                camera.look_at = ReadVec(line);
+            } else if (keyword == "up") {
+                camera.up = ReadVec(line);
+            } else if (keyword == "fov") {
+                camera.fov = Read<f64>(line, "fov");
+            } else if (keyword == "focal_length") {
+                camera.focal_length = Read<f64>(line, "focal length");
+            } else if (keyword == "defocus_angle") {
+                camera.defocus_angle = Read<f64>(line, "defocus angle");
+            } else if (keyword == "material") {
+                auto name = Read<std::string>(line, "material name");
+                auto kind = Read<std::string>(line, "material kind");
+
+                MaterialRecord mat;
+
+                if (kind == "lambertian") {
+                    mat.kind = MaterialKind::kLambertian;
+                    mat.albedo = ReadVec(line);
+                } else if (kind == "metal") {
+                    mat.kind = MaterialKind::kMetal;
+                    mat.albedo = ReadVec(line);
+                    mat.fuzz = Read<f64>(line, "fuzz");
+                } else if (kind == "dielectric") {
+                    mat.kind = MaterialKind::kDielectric;
+                    mat.eta = Read<f64>(line, "eta");
+                    mat.fuzz = Read<f64>(line, "fuzz");
+                } else if (kind == "light") {
+                    mat.kind = MaterialKind::kDiffuseLight;
+                    mat.albedo = ReadVec(line);
+                } else {
+                    throw ParseError{"unknown material kind " + kind};
+                }
+
+                material_ids[name] = scene.AddMaterial(mat);
+            } else if (keyword == "sphere") {
+                auto centre = ReadVec(line);
+                auto radius = Read<f64>(line, "radius");
+
+                scene.AddSphere(Point3{centre[0], centre[1], centre[2]}, radius, material(line));
+            } else if (keyword == "rectangle") {
+                RectangleRecord rect;
+
+                rect.origin = ReadVec(line);
+                rect.a = ReadVec(line);
+                rect.b = ReadVec(line);
+                rect.mat = material(line);
+
+                Vec3 a{rect.a[0], rect.a[1], rect.a[2]};
+                Vec3 b{rect.b[0], rect.b[1], rect.b[2]};
+
+                if (!is_zero(dot(a, b))) {
+                    throw ParseError{"rectangle sides must be orthogonal"};
+                }
+
+                scene.AddRectangle(rect);
+            } else {
+                throw ParseError{"unknown statement " + keyword};
+            }
+
+            if (std::string rest; line >> rest) {
+                throw ParseError{"trailing " + rest};
+            }
+        } catch (const ParseError& e) {
+            throw ParseError{"line " + std::to_string(line_no) + ": " + e.what()};
+        }
+    }
+
+    if (camera.image_width == 0 || camera.image_height == 0) {
+        throw ParseError{"missing image size"};
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: " << argv[0] << " SCENE.txt SCENE.bin" << newline;
+        return 1;
+    }
+
+    std::ifstream in{argv[1]};
+
+    if (!in) {
+        std::cerr << "can't open " << argv[1] << newline;
+        return 1;
+    }
+
+    SceneBuilder scene;
+
+    try {
+        Parse(in, scene);
+    } catch (const ParseError& e) {
+        std::cerr << argv[1] << ": " << e.what() << newline;
+        return 1;
+    }
+
+    std::ofstream out{argv[2], std::ios::binary};
+
+    scene.Write(out);
+
+    if (!out.flush()) {
+        std::cerr << "can't write " << argv[2] << newline;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,480 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <numeric>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include "2dshapes.h"
+#include "aabb.h"
+#include "camera.h"
+#include "colour.h"
+#include "material.h"
+#include "packedspheres.h"
+#include "raytracer.h"
+#include "renderobject.h"
+#include "renderobjectlist.h"
+#include "vec3.h"
+
+// binary scene format
+//
+// a fixed size header followed by the sections it points to, each aligned to kSceneAlign:
+//
+//   materials    num_materials x MaterialRecord
+//   spheres      struct of arrays: x, y, z and radius as f64, material as u32, num_spheres each
+//   rectangles   num_rectangles x RectangleRecord
+//
+// all values are little endian. Spheres are stored in Morton order of their centres, so that any
+// run of consecutive spheres is spatially compact; the loader relies on that to group them into
+// `PackedSpheres` without sorting.
+
+constexpr std::array<char, 8> kSceneMagic{'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0'};
+constexpr u32 kSceneVersion = 1;
+
+constexpr std::size_t kSceneAlign = 64;
+
+enum class MaterialKind : u32 {
+    kLambertian = 0,
+    kMetal = 1,
+    kDielectric = 2,
+    kDiffuseLight = 3,
+};
+
+struct MaterialRecord {
+    MaterialKind kind = MaterialKind::kLambertian;
+    u32 reserved = 0;
+
+    std::array<f64, 3> albedo{};  // lambertian and metal, emission of diffuse lights
+    f64 fuzz = 0.0;               // metal and dielectric
+    f64 eta = 1.0;                // dielectric
+};
+
+struct RectangleRecord {
+    std::array<f64, 3> origin{};
+    std::array<f64, 3> a{};
+    std::array<f64, 3> b{};
+
+    MaterialId mat = 0;
+    u32 reserved = 0;
+};
+
+struct CameraRecord {
+    u32 image_width = 0;
+    u32 image_height = 0;
+
+    std::array<f64, 3> centre{};
+    std::array<f64, 3> look_at{};
+    std::array<f64, 3> up{};
+
+    f64 fov = 0.0;
+    f64 focal_length = 0.0;
+    f64 defocus_angle = 0.0;
+};
+
+struct SceneHeader {
+    std::array<char, 8> magic = kSceneMagic;
+    u32 version = kSceneVersion;
+    u32 reserved = 0;
+
+    CameraRecord camera;
+
+    u64 num_materials = 0;
+    u64 num_spheres = 0;
+    u64 num_rectangles = 0;
+
+    // byte offsets from the start of the file
+    u64 materials_offset = 0;
+    u64 sphere_x_offset = 0;
+    u64 sphere_y_offset = 0;
+    u64 sphere_z_offset = 0;
+    u64 sphere_radius_offset = 0;
+    u64 sphere_material_offset = 0;
+    u64 rectangles_offset = 0;
+};
+
+static_assert(std::is_trivially_copyable_v<SceneHeader>);
+static_assert(std::is_trivially_copyable_v<MaterialRecord>);
+static_assert(std::is_trivially_copyable_v<RectangleRecord>);
+
+static_assert(sizeof(MaterialRecord) == 48);
+static_assert(sizeof(RectangleRecord) == 80);
+
+constexpr Camera ToCamera(const CameraRecord& rec) {
+    auto vec = [](const std::array<f64, 3>& a) { return Vec3{a[0], a[1], a[2]}; };
+
+    Camera camera{rec.image_width, rec.image_height};
+
+    camera.centre(vec(rec.centre));
+    camera.look_at(vec(rec.look_at));
+    camera.up(vec(rec.up));
+    camera.fov(rec.fov);
+    camera.focal_length(rec.focal_length);
+    camera.defocus_angle(rec.defocus_angle);
+
+    camera.Update();
+
+    return camera;
+}
+
+constexpr Material ToMaterial(const MaterialRecord& rec) {
+    Colour albedo{rec.albedo[0], rec.albedo[1], rec.albedo[2]};
+
+    switch (rec.kind) {
+        case MaterialKind::kLambertian:
+            return Lambertian{albedo};
+        case MaterialKind::kMetal:
+            return Metal{albedo, rec.fuzz};
+        case MaterialKind::kDielectric:
+            return Dielectric{rec.eta, rec.fuzz};
+        case MaterialKind::kDiffuseLight:
+            return DiffuseLight{albedo};
+    }
+
+    throw std::runtime_error("unknown material kind " +
+                             std::to_string(static_cast<u32>(rec.kind)));
+}
+
+// a scene being assembled in memory, e.g. by the text converter, and written out in one go
+class SceneBuilder {
+   public:
+    CameraRecord& camera() { return camera_; }
+
+    MaterialId AddMaterial(const MaterialRecord& mat) {
+        materials_.push_back(mat);
+
+        return static_cast<MaterialId>(materials_.size() - 1);
+    }
+
+    void AddSphere(Point3 centre, f64 radius, MaterialId mat) {
+        assert(radius >= 0);
+
+        spheres_.push_back(SphereRecord{centre, radius, mat});
+    }
+
+    void AddRectangle(const RectangleRecord& rect) { rectangles_.push_back(rect); }
+
+    std::size_t num_materials() const { return materials_.size(); }
+
+    void Write(std::ostream& os) {
+        SortSpheres();
+
+        const u64 n = spheres_.size();
+
+        SceneHeader header;
+
+        header.camera = camera_;
+        header.num_materials = materials_.size();
+        header.num_spheres = n;
+        header.num_rectangles = rectangles_.size();
+
+        u64 offset = Align(sizeof(SceneHeader));
+
+        auto place = [&offset](u64& section_offset, u64 size) {
+            section_offset = offset;
+            offset = Align(offset + size);
+        };
+
+        place(header.materials_offset, materials_.size() * sizeof(MaterialRecord));
+        place(header.sphere_x_offset, n * sizeof(f64));
+        place(header.sphere_y_offset, n * sizeof(f64));
+        place(header.sphere_z_offset, n * sizeof(f64));
+        place(header.sphere_radius_offset, n * sizeof(f64));
+        place(header.sphere_material_offset, n * sizeof(MaterialId));
+        place(header.rectangles_offset, rectangles_.size() * sizeof(RectangleRecord));
+
+        // assemble the whole file and write it with a single call
+        std::vector<std::byte> out(offset);
+
+        auto put = [&out](u64 at, const void* data, std::size_t size) {
+            if (size > 0) {
+                std::memcpy(out.data() + at, data, size);
+            }
+        };
+
+        auto put_column = [&](u64 at, auto field) {
+            for (std::size_t i = 0; i < spheres_.size(); i++) {
+                auto value = field(spheres_[i]);
+                put(at + i * sizeof(value), &value, sizeof(value));
+            }
+        };
+
+        put(0, &header, sizeof(header));
+        put(header.materials_offset, materials_.data(), materials_.size() * sizeof(MaterialRecord));
+
+        put_column(header.sphere_x_offset, [](const SphereRecord& s) { return s.centre.x(); });
+        put_column(header.sphere_y_offset, [](const SphereRecord& s) { return s.centre.y(); });
+        put_column(header.sphere_z_offset, [](const SphereRecord& s) { return s.centre.z(); });
+        put_column(header.sphere_radius_offset, [](const SphereRecord& s) { return s.radius; });
+        put_column(header.sphere_material_offset, [](const SphereRecord& s) { return s.mat; });
+
+        put(header.rectangles_offset, rectangles_.data(),
+            rectangles_.size() * sizeof(RectangleRecord));
+
+        os.write(reinterpret_cast<const char*>(out.data()),
+                 static_cast<std::streamsize>(out.size()));
+    }
+
+   private:
+    struct SphereRecord {
+        Point3 centre;
+        f64 radius;
+        MaterialId mat;
+    };
+
+    static constexpr u64 Align(u64 offset) {
+        return (offset + kSceneAlign - 1) / kSceneAlign * kSceneAlign;
+    }
+
+    // spread the lower 21 bits of `x` to every third bit
+    static constexpr u64 SpreadBits(u64 x) {
+        x &= 0x1fffff;
+        x = (x | x << 32) & 0x1f00000000ffff;
+        x = (x | x << 16) & 0x1f0000ff0000ff;
+        x = (x | x << 8) & 0x100f00f00f00f00f;
+        x = (x | x << 4) & 0x10c30c30c30c30c3;
+        x = (x | x << 2) & 0x1249249249249249;
+
+        return x;
+    }
+
+    void SortSpheres() {
+        AABB box;
+
+        for (const auto& s : spheres_) {
+            box.Extend(s.centre);
+        }
+
+        auto morton = [&box](Point3 p) {
+            constexpr f64 kScale = (1 << 21) - 1;
+
+            u64 code = 0;
+
+            for (u32 axis = 0; axis < 3; axis++) {
+                f64 extent = box.extent()[axis];
+                f64 rel = extent > 0.0 ? (p[axis] - box.min()[axis]) / extent : 0.0;
+
+                code |= SpreadBits(static_cast<u64>(rel * kScale)) << axis;
+            }
+
+            return code;
+        };
+
+        std::vector<u64> codes(spheres_.size());
+        std::vector<u32> order(spheres_.size());
+
+        for (std::size_t i = 0; i < spheres_.size(); i++) {
+            codes[i] = morton(spheres_[i].centre);
+        }
+
+        std::iota(order.begin(), order.end(), 0u);
+        std::ranges::stable_sort(order, [&codes](u32 a, u32 b) { return codes[a] < codes[b]; });
+
+        std::vector<SphereRecord> sorted;
+        sorted.reserve(spheres_.size());
+
+        for (u32 i : order) {
+            sorted.push_back(spheres_[i]);
+        }
+
+        spheres_ = std::move(sorted);
+    }
+
+    CameraRecord camera_;
+
+    std::vector<MaterialRecord> materials_;
+    std::vector<SphereRecord> spheres_;
+    std::vector<RectangleRecord> rectangles_;
+};
+
+// read-only mapping of a scene file, the primitive arrays are used in place
+class MappedScene {
+   public:
+    // spheres per `PackedSpheres` handed to the BVH, one AVX-512 batch
+    static constexpr std::size_t kSpheresPerGroup = 8;
+
+    explicit MappedScene(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+        }
+
+        struct stat st {};
+
+        if (fstat(fd, &st) < 0) {
+            int err = errno;
+            close(fd);
+            throw std::system_error(err, std::generic_category(), "stat " + path);
+        }
+
+        size_ = static_cast<std::size_t>(st.st_size);
+
+        if (size_ < sizeof(SceneHeader)) {
+            close(fd);
+            throw std::runtime_error(path + ": not a scene file");
+        }
+
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        // the mapping keeps the file alive
+        int err = errno;
+        close(fd);
+
+        if (data == MAP_FAILED) {
+            throw std::system_error(err, std::generic_category(), "mmap " + path);
+        }
+
+        data_ = static_cast<const std::byte*>(data);
+
+        try {
+            Validate(path);
+        } catch (...) {
+            munmap(const_cast<std::byte*>(data_), size_);
+            throw;
+        }
+    }
+
+    MappedScene(const MappedScene&) = delete;
+    MappedScene& operator=(const MappedScene&) = delete;
+
+    MappedScene(MappedScene&&) = delete;
+    MappedScene& operator=(MappedScene&&) = delete;
+
+    ~MappedScene() { munmap(const_cast<std::byte*>(data_), size_); }
+
+    const SceneHeader& header() const { return *reinterpret_cast<const SceneHeader*>(data_); }
+
+    // the whole file
+    std::span<const std::byte> bytes() const { return {data_, size_}; }
+
+    Camera camera() const { return ToCamera(header().camera); }
+
+    std::span<const MaterialRecord> material_records() const {
+        return Section<MaterialRecord>(header().materials_offset, header().num_materials);
+    }
+
+    std::span<const RectangleRecord> rectangles() const {
+        return Section<RectangleRecord>(header().rectangles_offset, header().num_rectangles);
+    }
+
+    std::span<const f64> sphere_x() const { return SphereColumn<f64>(header().sphere_x_offset); }
+    std::span<const f64> sphere_y() const { return SphereColumn<f64>(header().sphere_y_offset); }
+    std::span<const f64> sphere_z() const { return SphereColumn<f64>(header().sphere_z_offset); }
+
+    std::span<const f64> sphere_radius() const {
+        return SphereColumn<f64>(header().sphere_radius_offset);
+    }
+
+    std::span<const MaterialId> sphere_material() const {
+        return SphereColumn<MaterialId>(header().sphere_material_offset);
+    }
+
+    MaterialTable materials() const {
+        MaterialTable table;
+
+        for (const auto& rec : material_records()) {
+            table.Add(ToMaterial(rec));
+        }
+
+        return table;
+    }
+
+    // the scene's objects, ready to be handed to a BVH. Spheres become `PackedSpheres` viewing
+    // runs of `kSpheresPerGroup` spheres in the mapping, so this must outlive them.
+    RenderObjectList Objects() const {
+        RenderObjectList list;
+
+        const std::size_t n = header().num_spheres;
+
+        for (std::size_t first = 0; first < n; first += kSpheresPerGroup) {
+            std::size_t count = std::min(kSpheresPerGroup, n - first);
+
+            list.Emplace<PackedSpheres>(sphere_x().subspan(first, count),
+                                        sphere_y().subspan(first, count),
+                                        sphere_z().subspan(first, count),
+                                        sphere_radius().subspan(first, count),
+                                        sphere_material().subspan(first, count));
+        }
+
+        auto vec = [](const std::array<f64, 3>& a) { return Vec3{a[0], a[1], a[2]}; };
+
+        for (const auto& rect : rectangles()) {
+            list.Emplace<Rectangle>(vec(rect.origin), vec(rect.a), vec(rect.b), rect.mat);
+        }
+
+        return list;
+    }
+
+   private:
+    template <typename T>
+    std::span<const T> Section(u64 offset, u64 count) const {
+        return {reinterpret_cast<const T*>(data_ + offset), count};
+    }
+
+    template <typename T>
+    std::span<const T> SphereColumn(u64 offset) const {
+        return Section<T>(offset, header().num_spheres);
+    }
+
+    void Validate(const std::string& path) const {
+        const SceneHeader& h = header();
+
+        auto fail = [&path](const std::string& what) {
+            throw std::runtime_error(path + ": " + what);
+        };
+
+        if (h.magic != kSceneMagic) {
+            fail("not a scene file");
+        }
+
+        if (h.version != kSceneVersion) {
+            fail("unsupported scene version " + std::to_string(h.version));
+        }
+
+        // every section has to be aligned for its type and lie within the file
+        auto check = [&](u64 offset, u64 count, std::size_t elem_size, const char* name) {
+            bool ok = offset % kSceneAlign == 0 && offset <= size_ &&
+                      count <= (size_ - offset) / elem_size;
+
+            if (!ok) {
+                fail(std::string{"bad "} + name + " section");
+            }
+        };
+
+        check(h.materials_offset, h.num_materials, sizeof(MaterialRecord), "materials");
+        check(h.sphere_x_offset, h.num_spheres, sizeof(f64), "sphere x");
+        check(h.sphere_y_offset, h.num_spheres, sizeof(f64), "sphere y");
+        check(h.sphere_z_offset, h.num_spheres, sizeof(f64), "sphere z");
+        check(h.sphere_radius_offset, h.num_spheres, sizeof(f64), "sphere radius");
+        check(h.sphere_material_offset, h.num_spheres, sizeof(MaterialId), "sphere material");
+        check(h.rectangles_offset, h.num_rectangles, sizeof(RectangleRecord), "rectangles");
+
+        if (h.camera.image_width == 0 || h.camera.image_height == 0) {
+            fail("empty image");
+        }
+
+        auto bad_id = [&h](MaterialId id) { return id >= h.num_materials; };
+
+        if (std::ranges::any_of(sphere_material(), bad_id) ||
+            std::ranges::any_of(rectangles(), bad_id, &RectangleRecord::mat)) {
+            fail("material index out of range");
+        }
+    }
+
+    const std::byte* data_ = nullptr;
+    std::size_t size_ = 0;
+};
@@ -0,0 +1,420 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "2dshapes.h"
+#include "bvh.h"
+#include "camera.h"
+#include "colour.h"
+#include "instance.h"
+#include "material.h"
+#include "rand.h"
+#include "raytracer.h"
+#include "renderobjectlist.h"
+#include "sphere.h"
+#include "transform.h"
+#include "trianglemesh.h"
+#include "vec3.h"
+
+// built-in scenes: the one `ray-tracer` renders without --scene, and the canonical scenes of the
+// end-to-end benchmark. Each adds its objects and materials and returns a camera for an image of
+// the given size; randomly placed objects come from a fixed seed, so a scene is the same on every
+// run.
+
+// the scene used without --scene
+inline Camera DefaultScene(RenderObjectList& world, MaterialTable& materials,
+                           u32 image_width = 1200, u32 image_height = 675) {
+    constexpr f64 focal_length = 5.0;
+
+    /* auto lamb = materials.Add(Lambertian{Colour{0.7, 0.0, 0.5}});
+    auto metal = materials.Add(Metal{Colour{0.3, 0.3, 0.3}, 0.0});
+
+    auto ground = std::make_unique<Sphere>(Point3{0, -100.5, -1}, 100, metal);
+    auto sphere = std::make_unique<Sphere>(-Vec3::e_z, 0.5, lamb);
+
+    world.Add(std::move(ground));
+    world.Add(std::move(sphere)); */
+
+    auto mat_ground = materials.Add(Lambertian{Colour(0.8, 0.8, 0.0)});
+    auto mat_lamb = materials.Add(Lambertian{Colour(1.0, 0.0, 0.0)});
+    // auto mat_metal = materials.Add(Metal{Colour(0.9, 0.4, 0.6), 0.0});
+    // auto mat_metal2 = materials.Add(Metal{Colour(0.3, 0.5, 0.9), 0.0});
+    // auto mat_dielec = materials.Add(Dielectric{1.5, 0.0});
+    // auto mat_dielec2 = materials.Add(Dielectric{0.66, 0.0});
+
+    world.Emplace<Sphere>(Point3(0, -100, 0), 100, mat_ground);
+
+    world.Emplace<Rectangle>(Point3(-2.5, -2.5, 50), 5 * Vec3::e_x, 5 * Vec3::e_y, mat_lamb);
+
+    /* constexpr i32 N = 5;
+
+    for (i32 x = -N; x <= N; x++) {
+        for (i32 y = 0; y <= N; y++) {
+            world.Emplace<Rectangle>(Point3(x, y, 50), Vec3::e_x, Vec3::e_y,
+                                     (x + y) % 2 == 0 ? mat_lamb : mat_lamb2);
+        }
+    } */
+
+    // world.Emplace<Sphere>(Point3(-1.0, 0.0, 0.0), 0.5, mat_dielec);
+    // world.Emplace<Sphere>(Point3(-1.0, 0.0, 0.0), 0.4, mat_dielec2);
+
+    // world.Emplace<Sphere>(Point3{-1, 0, 0}, 0.5, mat_metal2);
+
+    // world.Emplace<Sphere>(Point3(1, 0, 0), 0.5, mat_metal);
+
+    /* for (f64 z = 0.5; z < 10; z += 0.5) {
+        world.Emplace<Sphere>(Point3(1, 0, z), 1 * z / focal_length, mat_metal);
+    } */
+
+    // camera
+
+    assert(image_width >= 1 && image_height >= 1);
+
+    constexpr Point3 camera_centre{0, 1, -1};
+
+    Camera camera{image_width, image_height};
+
+    camera.centre(camera_centre);
+    camera.look_at(Vec3{0, 0, 1});
+    camera.focal_length(focal_length);
+
+    camera.defocus_angle(1);
+    // camera.focal_length(1);
+
+    // camera.fov(40);
+    // camera.centre(Point3{-2, 2, 1});
+
+    camera.Update();
+
+    return camera;
+}
+
+namespace scenes_detail {
+
+// the random stream scenes are generated from
+inline RandomGen& SceneRandom(u32 seed) {
+    auto& rand = RandomGen::GenInstance();
+    rand.StartSample(seed, 0, 0);
+
+    return rand;
+}
+
+inline Camera LookingAt(u32 image_width, u32 image_height, Point3 centre, Point3 look_at,
+                        f64 fov) {
+    Camera camera{image_width, image_height};
+
+    camera.centre(centre);
+    camera.look_at(look_at);
+    camera.fov(fov);
+
+    camera.Update();
+
+    return camera;
+}
+
+// sphere tessellated into `rings` x `segments` quads (triangles at the poles), with vertex normals
+inline TriangleMesh SphereMesh(Point3 centre, f64 radius, u32 rings, u32 segments,
+                               MaterialId mat) {
+    std::vector<Point3> positions;
+    std::vector<Vec3> normals;
+    std::vector<u32> indices;
+
+    for (u32 r = 0; r <= rings; r++) {
+        f64 theta = kPi * r / rings;
+
+        for (u32 s = 0; s < segments; s++) {
+            f64 phi = 2 * kPi * s / segments;
+
+            Vec3 n{std::sin(theta) * std::cos(phi), std::cos(theta),
+                   std::sin(theta) * std::sin(phi)};
+
+            // sin(pi) isn't quite 0, so the last ring would be a tiny circle instead of one point
+            // and leave slivers open around the pole
+            if (r == 0 || r == rings) {
+                n = r == 0 ? Vec3::e_y : -Vec3::e_y;
+            }
+
+            positions.push_back(centre + radius * n);
+            normals.push_back(n);
+        }
+    }
+
+    auto vertex = [segments](u32 r, u32 s) { return r * segments + s % segments; };
+
+    for (u32 r = 0; r < rings; r++) {
+        for (u32 s = 0; s < segments; s++) {
+            if (r > 0) {
+                indices.insert(indices.end(),
+                               {vertex(r, s), vertex(r, s + 1), vertex(r + 1, s)});
+            }
+
+            if (r + 1 < rings) {
+                indices.insert(indices.end(),
+                               {vertex(r, s + 1), vertex(r + 1, s + 1), vertex(r + 1, s)});
+            }
+        }
+    }
+
+    std::vector<u32> normal_indices = indices;
+
+    return TriangleMesh{std::move(positions), std::move(normals), std::move(indices),
+                        std::move(normal_indices), mat};
+}
+
+}  // namespace scenes_detail
+
+// a ground plane covered with a grid of small spheres of random materials, mostly diffuse
+inline Camera SphereFieldScene(RenderObjectList& world, MaterialTable& materials,
+                               u32 image_width, u32 image_height) {
+    auto& rand = scenes_detail::SceneRandom(1);
+
+    world.Emplace<Sphere>(Point3{0, -1000, 0}, 1000,
+                          materials.Add(Lambertian{Colour{0.5, 0.5, 0.5}}));
+
+    constexpr i32 kHalfSize = 11;
+
+    for (i32 a = -kHalfSize; a < kHalfSize; a++) {
+        for (i32 b = -kHalfSize; b < kHalfSize; b++) {
+            Point3 centre{a + 0.9 * rand.Uniform(), 0.2, b + 0.9 * rand.Uniform()};
+
+            f64 choice = rand.Uniform();
+
+            Colour colour{rand.Uniform(), rand.Uniform(), rand.Uniform()};
+
+            MaterialId mat = 0;
+
+            if (choice < 0.8) {
+                mat = materials.Add(Lambertian{colour * colour});
+            } else if (choice < 0.95) {
+                mat = materials.Add(Metal{0.5 * colour + Colour{0.5, 0.5, 0.5}, 0.5 * choice});
+            } else {
+                mat = materials.Add(Dielectric{1.5, 0.0});
+            }
+
+            world.Emplace<Sphere>(centre, 0.2, mat);
+        }
+    }
+
+    world.Emplace<Sphere>(Point3{0, 1, 0}, 1.0, materials.Add(Dielectric{1.5, 0.0}));
+    world.Emplace<Sphere>(Point3{-4, 1, 0}, 1.0, materials.Add(Lambertian{Colour{0.4, 0.2, 0.1}}));
+    world.Emplace<Sphere>(Point3{4, 1, 0}, 1.0, materials.Add(Metal{Colour{0.7, 0.6, 0.5}, 0.0}));
+
+    return scenes_detail::LookingAt(image_width, image_height, Point3{13, 2, 3}, Point3{0, 0, 0},
+                                    20);
+}
+
+// glass spheres, hollow glass spheres and glass panes in front of a diffuse backdrop, so most
+// paths are long chains of refractions and reflections
+inline Camera GlassScene(RenderObjectList& world, MaterialTable& materials, u32 image_width,
+                         u32 image_height) {
+    auto glass = materials.Add(Dielectric{1.5, 0.0});
+    auto frosted = materials.Add(Dielectric{1.5, 0.1});
+    auto air_in_glass = materials.Add(Dielectric{1 / 1.5, 0.0});
+
+    auto ground = materials.Add(Lambertian{Colour{0.2, 0.3, 0.1}});
+    auto backdrop = materials.Add(Lambertian{Colour{0.8, 0.4, 0.2}});
+
+    world.Emplace<Sphere>(Point3{0, -1000, 0}, 1000, ground);
+    world.Emplace<Rectangle>(Point3{-8, 0, -4}, 16 * Vec3::e_x, 8 * Vec3::e_y, backdrop);
+
+    constexpr i32 kHalfSize = 3;
+
+    for (i32 a = -kHalfSize; a <= kHalfSize; a++) {
+        for (i32 b = -kHalfSize; b <= kHalfSize; b++) {
+            Point3 centre{1.2 * a, 0.5, 1.2 * b};
+
+            world.Emplace<Sphere>(centre, 0.5, (a + b) % 3 == 0 ? frosted : glass);
+
+            // every other sphere is a hollow shell
+            if ((a + b) % 2 == 0) {
+                world.Emplace<Sphere>(centre, 0.4, air_in_glass);
+            }
+        }
+    }
+
+    for (i32 k = 0; k < 4; k++) {
+        world.Emplace<Rectangle>(Point3{-3.0 + 1.5 * k, 0, 4.5}, Vec3::e_x, 2 * Vec3::e_y, glass);
+    }
+
+    return scenes_detail::LookingAt(image_width, image_height, Point3{0, 4, 10}, Point3{0, 0.5, 0},
+                                    40);
+}
+
+// a tessellated sphere of about a million triangles on a field of 100k small spheres, to measure
+// how rendering scales with the number of primitives
+inline Camera ManyPrimitivesScene(RenderObjectList& world, MaterialTable& materials,
+                                  u32 image_width, u32 image_height) {
+    auto& rand = scenes_detail::SceneRandom(2);
+
+    world.Emplace<Sphere>(Point3{0, -1000, 0}, 1000,
+                          materials.Add(Lambertian{Colour{0.5, 0.5, 0.5}}));
+
+    std::array<MaterialId, 3> mats{materials.Add(Lambertian{Colour{0.7, 0.3, 0.3}}),
+                                   materials.Add(Lambertian{Colour{0.3, 0.7, 0.3}}),
+                                   materials.Add(Metal{Colour{0.8, 0.8, 0.8}, 0.2})};
+
+    constexpr u32 kNumSpheres = 100'000;
+
+    for (u32 k = 0; k < kNumSpheres; k++) {
+        Vec3 d = rand.UnitDiskVec3();
+        Point3 centre{40 * d.x(), 0.05, 40 * d.y()};
+
+        world.Emplace<Sphere>(centre, 0.05, mats[k % mats.size()]);
+    }
+
+    auto mesh_mat = materials.Add(Metal{Colour{0.9, 0.8, 0.6}, 0.05});
+
+    world.Emplace<TriangleMesh>(
+        scenes_detail::SphereMesh(Point3{0, 2, 0}, 2.0, 500, 1000, mesh_mat));
+
+    return scenes_detail::LookingAt(image_width, image_height, Point3{0, 5, 12}, Point3{0, 1, 0},
+                                    50);
+}
+
+// a closed box with red and green side walls, lit only by a small light on the ceiling, with a
+// diffuse and a glass sphere on the floor: the case direct light sampling is for
+inline Camera CornellBoxScene(RenderObjectList& world, MaterialTable& materials, u32 image_width,
+                              u32 image_height) {
+    auto white = materials.Add(Lambertian{Colour{0.73, 0.73, 0.73}});
+    auto red = materials.Add(Lambertian{Colour{0.65, 0.05, 0.05}});
+    auto green = materials.Add(Lambertian{Colour{0.12, 0.45, 0.15}});
+    auto light = materials.Add(DiffuseLight{Colour{15, 15, 15}});
+    auto glass = materials.Add(Dielectric{1.5, 0.0});
+
+    // the box is [-1, 1] x [0, 2] x [-1, 3] with the camera just inside its front wall. Rectangles
+    // scatter to the side of their normal, a x b, so all walls face inwards.
+    world.Emplace<Rectangle>(Point3{-1, 0, -1}, 4 * Vec3::e_z, 2 * Vec3::e_x, white);
+    world.Emplace<Rectangle>(Point3{-1, 2, -1}, 2 * Vec3::e_x, 4 * Vec3::e_z, white);
+    world.Emplace<Rectangle>(Point3{-1, 0, -1}, 2 * Vec3::e_x, 2 * Vec3::e_y, white);
+    world.Emplace<Rectangle>(Point3{-1, 0, 3}, 2 * Vec3::e_y, 2 * Vec3::e_x, white);
+    world.Emplace<Rectangle>(Point3{-1, 0, -1}, 2 * Vec3::e_y, 4 * Vec3::e_z, red);
+    world.Emplace<Rectangle>(Point3{1, 0, -1}, 4 * Vec3::e_z, 2 * Vec3::e_y, green);
+
+    world.Emplace<Rectangle>(Point3{-0.25, 1.99, -0.25}, 0.5 * Vec3::e_x, 0.5 * Vec3::e_z, light);
+
+    world.Emplace<Sphere>(Point3{-0.4, 0.4, -0.3}, 0.4, white);
+    world.Emplace<Sphere>(Point3{0.45, 0.35, 0.3}, 0.35, glass);
+
+    return scenes_detail::LookingAt(image_width, image_height, Point3{0, 1, 2.9}, Point3{0, 1, 0},
+                                    50);
+}
+
+// night scene lit by thousands of small lights: a wall of coloured LED panels behind a field of
+// lamps of random colours and brightness, with diffuse and metal spheres in between. A black
+// dome hides the sky.
+inline Camera ManyLightsScene(RenderObjectList& world, MaterialTable& materials, u32 image_width,
+                              u32 image_height) {
+    auto& rand = scenes_detail::SceneRandom(3);
+
+    world.Emplace<Sphere>(Point3{0, 0, 0}, 200, materials.Add(Lambertian{Colour::kBlack}));
+    world.Emplace<Sphere>(Point3{0, -1000, 0}, 1000,
+                          materials.Add(Lambertian{Colour{0.4, 0.4, 0.4}}));
+
+    constexpr i32 kWallColumns = 48;
+    constexpr i32 kWallRows = 24;
+    constexpr f64 kPanelPitch = 0.2;
+
+    for (i32 x = 0; x < kWallColumns; x++) {
+        for (i32 y = 0; y < kWallRows; y++) {
+            Colour colour{rand.Uniform(), rand.Uniform(), rand.Uniform()};
+            auto mat = materials.Add(DiffuseLight{(2 + 10 * rand.Uniform()) * colour});
+
+            Point3 corner{(x - kWallColumns / 2) * kPanelPitch, 0.5 + y * kPanelPitch, -6};
+
+            world.Emplace<Rectangle>(corner, 0.15 * Vec3::e_x, 0.15 * Vec3::e_y, mat);
+        }
+    }
+
+    constexpr u32 kNumLamps = 2000;
+
+    for (u32 k = 0; k < kNumLamps; k++) {
+        Vec3 d = rand.UnitDiskVec3();
+        Point3 centre{30 * d.x(), 0.1 + 3 * rand.Uniform(), 30 * d.y() - 10};
+
+        // mostly dim, a few bright
+        f64 brightness = 20 * std::pow(rand.Uniform(), 4.0);
+
+        auto mat = materials.Add(
+            DiffuseLight{brightness * Colour{1.0, 0.6 + 0.3 * rand.Uniform(), 0.3}});
+
+        world.Emplace<Sphere>(centre, 0.03, mat);
+    }
+
+    auto diffuse = materials.Add(Lambertian{Colour{0.7, 0.7, 0.7}});
+    auto metal = materials.Add(Metal{Colour{0.8, 0.8, 0.9}, 0.1});
+
+    for (i32 k = 0; k < 12; k++) {
+        world.Emplace<Sphere>(Point3{-5.5 + k, 0.4, -2 + 0.5 * (k % 3)}, 0.4,
+                              k % 2 == 0 ? diffuse : metal);
+    }
+
+    return scenes_detail::LookingAt(image_width, image_height, Point3{0, 2, 7}, Point3{0, 1, -3},
+                                    60);
+}
+
+// a forest of one tree: a trunk of spheres under a tessellated crown is built once, with its own
+// BVH, and placed thousands of times turned, leaning and scaled, through `Instance`
+inline Camera ForestScene(RenderObjectList& world, MaterialTable& materials, u32 image_width,
+                          u32 image_height) {
+    auto& rand = scenes_detail::SceneRandom(4);
+
+    world.Emplace<Sphere>(Point3{0, -1000, 0}, 1000,
+                          materials.Add(Lambertian{Colour{0.35, 0.45, 0.2}}));
+
+    auto bark = materials.Add(Lambertian{Colour{0.35, 0.25, 0.15}});
+    auto leaves = materials.Add(Lambertian{Colour{0.2, 0.5, 0.15}});
+
+    RenderObjectList tree;
+
+    for (i32 k = 0; k < 6; k++) {
+        tree.Emplace<Sphere>(Point3{0, 0.1 + 0.2 * k, 0}, 0.12, bark);
+    }
+
+    tree.Emplace<TriangleMesh>(scenes_detail::SphereMesh(Point3{0, 1.8, 0}, 0.8, 32, 64, leaves));
+
+    // a side branch, so that turning the tree shows
+    tree.Emplace<Sphere>(Point3{0.55, 1.3, 0}, 0.35, leaves);
+
+    auto geometry = std::make_shared<const BVH>(std::move(tree));
+
+    constexpr u32 kNumTrees = 5000;
+
+    for (u32 k = 0; k < kNumTrees; k++) {
+        Vec3 d = rand.UnitDiskVec3();
+        Point3 base{60 * d.x(), 0, 60 * d.y() - 70};
+
+        f64 lean_dir = 2 * kPi * rand.Uniform();
+        Vec3 lean_axis{std::cos(lean_dir), 0, std::sin(lean_dir)};
+
+        Transform placement = Transform::Translate(base) *
+                              Transform::Rotate(lean_axis, 10 * rand.Uniform()) *
+                              Transform::Rotate(Vec3::e_y, 360 * rand.Uniform()) *
+                              Transform::Scale(0.6 + 0.8 * rand.Uniform());
+
+        world.Emplace<Instance>(geometry, placement);
+    }
+
+    return scenes_detail::LookingAt(image_width, image_height, Point3{0, 8, 12}, Point3{0, 0, -40},
+                                    50);
+}
+
+using SceneFn = Camera (*)(RenderObjectList&, MaterialTable&, u32, u32);
+
+// the canonical scenes of the end-to-end benchmark, by name
+constexpr std::array<std::pair<std::string_view, SceneFn>, 7> kCanonicalScenes{{
+    {"default", [](RenderObjectList& world, MaterialTable& materials, u32 width, u32 height) {
+         return DefaultScene(world, materials, width, height);
+     }},
+    {"sphere_field", SphereFieldScene},
+    {"glass", GlassScene},
+    {"many_primitives", ManyPrimitivesScene},
+    {"cornell_box", CornellBoxScene},
+    {"many_lights", ManyLightsScene},
+    {"forest", ForestScene},
+}};
@@ -1,21 +1,22 @@
 #pragma once
 
 #include <cassert>
-#include <memory>
 #include <optional>
 
+#include "aabb.h"
 #include "interval.h"
-#include "material.h"
+#include "lights.h"
 #include "ray.h"
 #include "raytracer.h"
 #include "renderobject.h"
+#include "renderstats.h"
 #include "vec3.h"
 
 class Sphere : public RenderObject {
    public:
     constexpr Sphere() = default;
 
-    Sphere(Point3 centre, f64 radius, const std::shared_ptr<Material>& mat)
+    Sphere(Point3 centre, f64 radius, MaterialId mat)
         : centre_{centre}, radius_{radius}, mat_{mat} {
         assert(radius >= 0);
     }
@@ -23,14 +24,14 @@ class Sphere : public RenderObject {
     constexpr Point3 centre() const { return centre_; }
     constexpr f64 radius() const { return radius_; }
 
-    std::optional<HitRecord> hit(const Ray& ray, Interval ts) const override {
-        HitRecord hit_record{};
+    bool intersect(const Ray& ray, Interval ts, Intersection& isect) const override {
+        IntersectionCounters::Count(PrimitiveKind::kSphere);
 
         auto t_low_high = ray.HitSphere(centre_, radius_);
 
         if (!t_low_high.has_value()) {
             // miss
-            return std::nullopt;
+            return false;
         }
 
         // hit
@@ -47,43 +48,77 @@ class Sphere : public RenderObject {
             // if the smaller t is already too large, we don't need to check the second one since it
             // will be even larger
 
-            return std::nullopt;
+            return false;
         }
 
         if (t_low > ts.min()) {
             // t_min is hit
 
-            hit_record.t = t_low;
-            // hit_record.front_face = true;
+            isect.t = t_low;
         } else {
             // if the smaller t is too small, check the larger one
 
             if (!ts.surronds(t_high)) {
                 // larger t also out of range: return false
 
-                return std::nullopt;
+                return false;
             }
 
-            // t_low hits front side, t_high hits back side
-            hit_record.t = t_high;
-            hit_record.front_face = false;
+            isect.t = t_high;
         }
 
-        hit_record.p = ray.At(hit_record.t);
-        hit_record.mat = mat_.get();
+        isect.obj = this;
+        isect.instance = nullptr;
+        isect.prim = 0;
 
-        if (hit_record.front_face) {
-            hit_record.normal = (hit_record.p - centre_) / radius_;
-        } else {
-            hit_record.normal = -(hit_record.p - centre_) / radius_;
+        return true;
+    }
+
+    HitRecord interaction(const Ray& ray, const Intersection& isect) const override {
+        HitRecord hit_record{};
+
+        hit_record.t = isect.t;
+        hit_record.p = ray.At(isect.t);
+        hit_record.mat = mat_;
+        hit_record.normal = (hit_record.p - centre_) / radius_;
+
+        // t_low hits the front side, t_high the back side, i.e. we hit the front face iff the ray
+        // enters the sphere at t
+        if (dot(hit_record.normal, ray.direction()) > 0) {
+            hit_record.normal = -hit_record.normal;
+            hit_record.front_face = false;
         }
 
         return hit_record;
     }
 
+    bool occluded(const Ray& ray, Interval ts) const override {
+        IntersectionCounters::Count(PrimitiveKind::kSphere);
+
+        auto t_low_high = ray.HitSphere(centre_, radius_);
+
+        if (!t_low_high.has_value()) {
+            return false;
+        }
+
+        auto [t_low, t_high] = t_low_high.value();
+
+        // same cases as `hit`
+        return t_low < ts.max() && (t_low > ts.min() || ts.surronds(t_high));
+    }
+
+    AABB bounds() const override {
+        Vec3 r{radius_, radius_, radius_};
+        return AABB{centre_ - r, centre_ + r};
+    }
+
+    void AddLights(LightList& lights) const override {
+        lights.Add(*this, 0, SphereShape{centre_, radius_}, mat_);
+    }
+
    private:
     Point3 centre_{};
     f64 radius_ = 0.0;
 
-    std::shared_ptr<Material> mat_;
+    MaterialId mat_ = 0;
 };
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "raytracer.h"
+
+// fixed set of worker threads with one task deque per worker
+//
+// workers pop from the back of their own deque and steal from the front of the others' when
+// they run dry. Tasks belong to a TaskGroup, which can be waited on; a worker waiting on a group
+// keeps running tasks in the meantime, so tasks may fork and join further tasks.
+class ThreadPool {
+   public:
+    static constexpr u32 kNoWorker = std::numeric_limits<u32>::max();
+
+    class TaskGroup {
+       public:
+        TaskGroup() = default;
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        TaskGroup(TaskGroup&&) = delete;
+        TaskGroup& operator=(TaskGroup&&) = delete;
+
+        ~TaskGroup() { assert(pending_.load() == 0); }
+
+        bool done() const { return pending_.load() == 0; }
+
+       private:
+        friend class ThreadPool;
+
+        std::atomic_uint32_t pending_ = 0;
+    };
+
+    // 0 threads means one per hardware thread
+    explicit ThreadPool(u32 num_threads = 0) {
+        if (num_threads == 0) {
+            num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+
+        workers_.reserve(num_threads);
+
+        for (u32 i = 0; i < num_threads; i++) {
+            workers_.emplace_back(std::make_unique<Worker>());
+        }
+
+        threads_.reserve(num_threads);
+
+        for (u32 i = 0; i < num_threads; i++) {
+            threads_.emplace_back([this, i] { WorkerLoop(i); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ThreadPool(ThreadPool&&) = delete;
+    ThreadPool& operator=(ThreadPool&&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock{sleep_mutex_};
+            stop_ = true;
+        }
+
+        sleep_cv_.notify_all();
+
+        for (auto& t : threads_) {
+            t.join();
+        }
+    }
+
+    u32 size() const { return static_cast<u32>(workers_.size()); }
+
+    // index of the calling thread within the pool it works for, or kNoWorker
+    static u32 CurrentWorker() { return current_worker_; }
+
+    // queue `task` on the calling worker's deque, or spread round-robin when called from outside
+    // the pool
+    void Submit(TaskGroup& group, std::function<void()> task) {
+        u32 worker = current_pool_ == this ? current_worker_
+                                           : next_worker_.fetch_add(1, std::memory_order_relaxed);
+
+        Submit(group, worker % size(), std::move(task));
+    }
+
+    // queue `task` on the deque of a specific worker
+    void Submit(TaskGroup& group, u32 worker, std::function<void()> task) {
+        assert(worker < size());
+
+        group.pending_.fetch_add(1);
+
+        {
+            std::lock_guard lock{workers_[worker]->mutex};
+            workers_[worker]->tasks.push_back(Task{std::move(task), &group});
+        }
+
+        queued_.fetch_add(1);
+
+        {
+            // make sure a worker about to go to sleep sees the new task
+            std::lock_guard lock{sleep_mutex_};
+        }
+
+        sleep_cv_.notify_one();
+    }
+
+    // block until all tasks of `group` have finished. Workers of this pool run other tasks while
+    // waiting, other threads sleep.
+    void Wait(TaskGroup& group) {
+        if (current_pool_ == this) {
+            while (!group.done()) {
+                if (!TryRunOne(current_worker_)) {
+                    std::this_thread::yield();
+                }
+            }
+
+            return;
+        }
+
+        std::unique_lock lock{done_mutex_};
+        done_cv_.wait(lock, [&group] { return group.done(); });
+    }
+
+    // call `fn(i)` for every i in [begin, end), split into contiguous chunks over the workers
+    template <typename F>
+    void ParallelFor(u32 begin, u32 end, F&& fn) {
+        if (begin >= end) {
+            return;
+        }
+
+        TaskGroup group;
+
+        const u32 n = end - begin;
+        const u32 num_chunks = std::min(n, size());
+
+        for (u32 chunk = 0; chunk < num_chunks; chunk++) {
+            u32 first = begin + static_cast<u32>(u64{chunk} * n / num_chunks);
+            u32 last = begin + static_cast<u32>(u64{chunk + 1} * n / num_chunks);
+
+            Submit(group, [&fn, first, last] {
+                for (u32 i = first; i < last; i++) {
+                    fn(i);
+                }
+            });
+        }
+
+        Wait(group);
+    }
+
+   private:
+    struct Task {
+        std::function<void()> fn;
+        TaskGroup* group;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // run one task, taken from the back of our own deque or stolen from the front of another
+    bool TryRunOne(u32 self) {
+        std::optional<Task> task = std::nullopt;
+
+        {
+            std::lock_guard lock{workers_[self]->mutex};
+
+            if (!workers_[self]->tasks.empty()) {
+                task = std::move(workers_[self]->tasks.back());
+                workers_[self]->tasks.pop_back();
+            }
+        }
+
+        for (u32 i = 1; !task.has_value() && i < size(); i++) {
+            Worker& victim = *workers_[(self + i) % size()];
+
+            std::lock_guard lock{victim.mutex};
+
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+            }
+        }
+
+        if (!task.has_value()) {
+            return false;
+        }
+
+        queued_.fetch_sub(1);
+
+        task->fn();
+
+        // the group may be destroyed as soon as its counter hits zero, so only touch the pool after
+        if (task->group->pending_.fetch_sub(1) == 1) {
+            {
+                std::lock_guard lock{done_mutex_};
+            }
+
+            done_cv_.notify_all();
+        }
+
+        return true;
+    }
+
+    void WorkerLoop(u32 self) {
+        current_pool_ = this;
+        current_worker_ = self;
+
+        while (true) {
+            if (TryRunOne(self)) {
+                continue;
+            }
+
+            std::unique_lock lock{sleep_mutex_};
+
+            sleep_cv_.wait(lock, [this] { return stop_ || queued_.load() > 0; });
+
+            if (stop_ && queued_.load() == 0) {
+                return;
+            }
+        }
+    }
+
+    static inline thread_local const ThreadPool* current_pool_ = nullptr;
+    static inline thread_local u32 current_worker_ = kNoWorker;
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    std::atomic_uint32_t queued_ = 0;
+    std::atomic_uint32_t next_worker_ = 0;
+
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cv_;
+    bool stop_ = false;
+
+    std::mutex done_mutex_;
+    std::condition_variable done_cv_;
+};
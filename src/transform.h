@@ -0,0 +1,133 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cmath>
+
+#include "aabb.h"
+#include "raytracer.h"
+#include "vec3.h"
+
+// affine transform x -> Mx + t, with the 3x3 matrix M stored by rows
+class Transform {
+   public:
+    static const Transform kIdentity;
+
+    constexpr Transform() = default;
+
+    constexpr Transform(std::array<Vec3, 3> rows, Vec3 translation)
+        : rows_{rows}, translation_{translation} {}
+
+    static constexpr Transform Translate(Vec3 t) {
+        return Transform{{Vec3::e_x, Vec3::e_y, Vec3::e_z}, t};
+    }
+
+    static constexpr Transform Scale(Vec3 s) {
+        return Transform{{s.x() * Vec3::e_x, s.y() * Vec3::e_y, s.z() * Vec3::e_z}, Vec3{}};
+    }
+
+    static constexpr Transform Scale(f64 s) { return Scale(Vec3{s, s, s}); }
+
+    // rotation by `degrees` around `axis`, counterclockwise looking against the axis
+    static Transform Rotate(Vec3 axis, f64 degrees) {
+        Vec3 a = axis.normed();
+
+        f64 c = std::cos(deg2rad(degrees));
+        f64 s = std::sin(deg2rad(degrees));
+
+        // Rodrigues' formula: c I + s [a]x + (1 - c) a a^T
+        auto row = [&](u32 i) {
+            Vec3 r = (1 - c) * a[i] * a;
+            r[i] += c;
+
+            return r;
+        };
+
+        Vec3 r0 = row(0);
+        Vec3 r1 = row(1);
+        Vec3 r2 = row(2);
+
+        r0 += Vec3{0, -s * a.z(), s * a.y()};
+        r1 += Vec3{s * a.z(), 0, -s * a.x()};
+        r2 += Vec3{-s * a.y(), s * a.x(), 0};
+
+        return Transform{{r0, r1, r2}, Vec3{}};
+    }
+
+    constexpr const std::array<Vec3, 3>& rows() const { return rows_; }
+    constexpr Vec3 translation() const { return translation_; }
+
+    constexpr Point3 ApplyPoint(Point3 p) const { return ApplyVector(p) + translation_; }
+
+    constexpr Vec3 ApplyVector(Vec3 v) const {
+        return Vec3{dot(rows_[0], v), dot(rows_[1], v), dot(rows_[2], v)};
+    }
+
+    // apply the transpose of M, which maps normals back when this is the inverse transform
+    constexpr Vec3 ApplyTransposed(Vec3 v) const {
+        return v.x() * rows_[0] + v.y() * rows_[1] + v.z() * rows_[2];
+    }
+
+    // tight box around the transformed box (Arvo, "Transforming Axis-Aligned Bounding Boxes")
+    constexpr AABB ApplyBounds(const AABB& box) const {
+        if (box.empty()) {
+            return box;
+        }
+
+        Point3 min = translation_;
+        Point3 max = translation_;
+
+        for (u32 i = 0; i < 3; i++) {
+            for (u32 j = 0; j < 3; j++) {
+                f64 a = rows_[i][j] * box.min()[j];
+                f64 b = rows_[i][j] * box.max()[j];
+
+                min[i] += std::min(a, b);
+                max[i] += std::max(a, b);
+            }
+        }
+
+        return AABB{min, max};
+    }
+
+    constexpr f64 Determinant() const { return dot(rows_[0], cross(rows_[1], rows_[2])); }
+
+    constexpr Transform Inverse() const {
+        f64 det = Determinant();
+
+        assert(det != 0.0);
+
+        // the columns of the inverse are the cross products of the rows, over the determinant
+        Vec3 c0 = cross(rows_[1], rows_[2]) / det;
+        Vec3 c1 = cross(rows_[2], rows_[0]) / det;
+        Vec3 c2 = cross(rows_[0], rows_[1]) / det;
+
+        Transform inv{{Vec3{c0.x(), c1.x(), c2.x()}, Vec3{c0.y(), c1.y(), c2.y()},
+                       Vec3{c0.z(), c1.z(), c2.z()}},
+                      Vec3{}};
+
+        inv.translation_ = -inv.ApplyVector(translation_);
+
+        return inv;
+    }
+
+   private:
+    std::array<Vec3, 3> rows_{Vec3::e_x, Vec3::e_y, Vec3::e_z};
+    Vec3 translation_;
+};
+
+constexpr Transform Transform::kIdentity{};
+
+// `a * b` applies `b` first, then `a`
+constexpr Transform operator*(const Transform& a, const Transform& b) {
+    const auto& r = b.rows();
+
+    // the columns of a's matrix times b's matrix are a applied to b's columns
+    Vec3 c0 = a.ApplyVector(Vec3{r[0].x(), r[1].x(), r[2].x()});
+    Vec3 c1 = a.ApplyVector(Vec3{r[0].y(), r[1].y(), r[2].y()});
+    Vec3 c2 = a.ApplyVector(Vec3{r[0].z(), r[1].z(), r[2].z()});
+
+    return Transform{{Vec3{c0.x(), c1.x(), c2.x()}, Vec3{c0.y(), c1.y(), c2.y()},
+                      Vec3{c0.z(), c1.z(), c2.z()}},
+                     a.ApplyPoint(b.translation())};
+}
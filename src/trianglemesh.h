@@ -0,0 +1,281 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "aabb.h"
+#include "bvh.h"
+#include "interval.h"
+#include "ray.h"
+#include "raytracer.h"
+#include "renderobject.h"
+#include "renderstats.h"
+#include "vec3.h"
+
+// indexed triangle mesh with its own BVH over the triangles
+//
+// vertex positions and normals are shared between triangles, each triangle has three indices
+// into the positions and, if the mesh has normals, three into the normals. All buffers are flat
+// arrays; the triangles are stored in the BVH's leaf order.
+class TriangleMesh : public RenderObject {
+   public:
+    // `indices` holds three position indices per triangle, `normal_indices` either the same
+    // number of normal indices or nothing, in which case the geometric normal is used
+    TriangleMesh(std::vector<Point3> positions, std::vector<Vec3> normals,
+                 std::vector<u32> indices, std::vector<u32> normal_indices, MaterialId mat,
+                 BVHBuildOptions options = {})
+        : positions_{std::move(positions)},
+          normals_{std::move(normals)},
+          indices_{std::move(indices)},
+          normal_indices_{std::move(normal_indices)},
+          mat_{mat} {
+        assert(indices_.size() % 3 == 0);
+        assert(normal_indices_.empty() || normal_indices_.size() == indices_.size());
+        assert(std::ranges::all_of(indices_, [&](u32 i) { return i < positions_.size(); }));
+        assert(std::ranges::all_of(normal_indices_, [&](u32 i) { return i < normals_.size(); }));
+
+        std::vector<AABB> bounds(size());
+
+        for (std::size_t tri = 0; tri < size(); tri++) {
+            auto [v0, v1, v2] = Vertices(tri);
+
+            bounds[tri] = AABB{v0, v0}.Extend(v1).Extend(v2);
+        }
+
+        std::vector<u32> order;
+        tree_ = BVHTree{bounds, order, options};
+
+        indices_ = Reordered(indices_, order);
+
+        if (!normal_indices_.empty()) {
+            normal_indices_ = Reordered(normal_indices_, order);
+        }
+    }
+
+    // number of triangles
+    std::size_t size() const { return indices_.size() / 3; }
+
+    std::span<const Point3> positions() const { return positions_; }
+    std::span<const Vec3> normals() const { return normals_; }
+    std::span<const u32> indices() const { return indices_; }
+
+    const BVHBuildStats& build_stats() const { return tree_.build_stats(); }
+
+    bool intersect(const Ray& ray, Interval ts, Intersection& isect) const override {
+        const RayShear shear{ray};
+
+        std::optional<TriangleHit> closest = std::nullopt;
+
+        tree_.Traverse(ray, ts, [&](u32 first, u32 count, Interval leaf_ts) {
+            for (u32 tri = first; tri < first + count; tri++) {
+                auto tri_hit = HitTriangle(ray, shear, tri, leaf_ts);
+
+                if (tri_hit.has_value()) {
+                    closest = tri_hit;
+                    leaf_ts = Interval{leaf_ts.min(), tri_hit->t};
+                }
+            }
+
+            return leaf_ts.max();
+        });
+
+        if (!closest.has_value()) {
+            return false;
+        }
+
+        isect.t = closest->t;
+        isect.obj = this;
+        isect.instance = nullptr;
+        isect.prim = closest->tri;
+        isect.bary = closest->bary;
+
+        return true;
+    }
+
+    HitRecord interaction(const Ray& ray, const Intersection& isect) const override {
+        return MakeHitRecord(ray, TriangleHit{isect.t, isect.bary, isect.prim});
+    }
+
+    bool occluded(const Ray& ray, Interval ts) const override {
+        const RayShear shear{ray};
+
+        return tree_.TraverseAny(ray, ts, [&](u32 first, u32 count, Interval leaf_ts) {
+            for (u32 tri = first; tri < first + count; tri++) {
+                if (HitTriangle(ray, shear, tri, leaf_ts).has_value()) {
+                    return true;
+                }
+            }
+
+            return false;
+        });
+    }
+
+    AABB bounds() const override { return tree_.bounds(); }
+
+   private:
+    // per ray constants of the watertight test: the ray is translated to the origin, the axis
+    // along which it is longest becomes z, and a shear turns it into the +z axis
+    struct RayShear {
+        explicit RayShear(const Ray& ray) {
+            Vec3 dir = ray.direction();
+
+            kz = 0;
+
+            for (u32 axis = 1; axis < 3; axis++) {
+                if (std::fabs(dir[axis]) > std::fabs(dir[kz])) {
+                    kz = axis;
+                }
+            }
+
+            kx = (kz + 1) % 3;
+            ky = (kx + 1) % 3;
+
+            // keep the winding of the triangles
+            if (dir[kz] < 0.0) {
+                std::swap(kx, ky);
+            }
+
+            sx = dir[kx] / dir[kz];
+            sy = dir[ky] / dir[kz];
+            sz = 1.0 / dir[kz];
+        }
+
+        u32 kx, ky, kz;
+        f64 sx, sy, sz;
+    };
+
+    struct TriangleHit {
+        f64 t;
+        std::array<f64, 3> bary;  // weights of the three vertices
+        u32 tri;
+    };
+
+    static std::vector<u32> Reordered(const std::vector<u32>& per_vertex,
+                                      const std::vector<u32>& order) {
+        std::vector<u32> out(per_vertex.size());
+
+        for (std::size_t pos = 0; pos < order.size(); pos++) {
+            for (u32 k = 0; k < 3; k++) {
+                out[3 * pos + k] = per_vertex[3 * std::size_t{order[pos]} + k];
+            }
+        }
+
+        return out;
+    }
+
+    std::array<Point3, 3> Vertices(std::size_t tri) const {
+        return {positions_[indices_[3 * tri]], positions_[indices_[3 * tri + 1]],
+                positions_[indices_[3 * tri + 2]]};
+    }
+
+    // watertight ray/triangle test (Woop, Benthin and Wald, "Watertight Ray/Triangle
+    // Intersection", JCGT 2013): edges shared by two triangles are evaluated identically for
+    // both, so rays can't slip through between them. That only holds if the products of u, v and
+    // w are rounded on their own, which is why the build turns off FMA contraction.
+    std::optional<TriangleHit> HitTriangle(const Ray& ray, const RayShear& shear, u32 tri,
+                                           Interval ts) const {
+        IntersectionCounters::Count(PrimitiveKind::kTriangle);
+
+        auto [v0, v1, v2] = Vertices(tri);
+
+        Point3 orig = ray.origin();
+
+        Vec3 a = v0 - orig;
+        Vec3 b = v1 - orig;
+        Vec3 c = v2 - orig;
+
+        f64 ax = a[shear.kx] - shear.sx * a[shear.kz];
+        f64 ay = a[shear.ky] - shear.sy * a[shear.kz];
+        f64 bx = b[shear.kx] - shear.sx * b[shear.kz];
+        f64 by = b[shear.ky] - shear.sy * b[shear.kz];
+        f64 cx = c[shear.kx] - shear.sx * c[shear.kz];
+        f64 cy = c[shear.ky] - shear.sy * c[shear.kz];
+
+        // scaled barycentrics, each is twice the signed area spanned by the ray and one edge
+        f64 u = cx * by - cy * bx;
+        f64 v = ax * cy - ay * cx;
+        f64 w = bx * ay - by * ax;
+
+        if ((u < 0.0 || v < 0.0 || w < 0.0) && (u > 0.0 || v > 0.0 || w > 0.0)) {
+            return std::nullopt;
+        }
+
+        f64 det = u + v + w;
+
+        if (det == 0.0) {
+            return std::nullopt;
+        }
+
+        f64 az = shear.sz * a[shear.kz];
+        f64 bz = shear.sz * b[shear.kz];
+        f64 cz = shear.sz * c[shear.kz];
+
+        f64 t = (u * az + v * bz + w * cz) / det;
+
+        if (!ts.surronds(t)) {
+            return std::nullopt;
+        }
+
+        return TriangleHit{t, {u / det, v / det, w / det}, tri};
+    }
+
+    HitRecord MakeHitRecord(const Ray& ray, const TriangleHit& tri_hit) const {
+        auto [v0, v1, v2] = Vertices(tri_hit.tri);
+
+        Vec3 geometric_normal = cross(v1 - v0, v2 - v0).normed();
+
+        HitRecord hit_record{};
+
+        hit_record.t = tri_hit.t;
+        hit_record.p = ray.At(tri_hit.t);
+        hit_record.mat = mat_;
+
+        // like `Sphere`, the normal always points against the ray
+        hit_record.front_face = dot(geometric_normal, ray.direction()) < 0.0;
+
+        if (!hit_record.front_face) {
+            geometric_normal = -geometric_normal;
+        }
+
+        hit_record.normal = geometric_normal;
+
+        if (!normal_indices_.empty()) {
+            const u32* ni = &normal_indices_[3 * std::size_t{tri_hit.tri}];
+
+            Vec3 shading_normal = (tri_hit.bary[0] * normals_[ni[0]] +
+                                   tri_hit.bary[1] * normals_[ni[1]] +
+                                   tri_hit.bary[2] * normals_[ni[2]]);
+
+            // interpolated normals can be degenerate or point through the surface at grazing
+            // angles, keep the geometric normal then
+            if (!shading_normal.almost_zero()) {
+                shading_normal = shading_normal.normed();
+
+                if (dot(shading_normal, geometric_normal) < 0.0) {
+                    shading_normal = -shading_normal;
+                }
+
+                hit_record.normal = shading_normal;
+            }
+        }
+
+        return hit_record;
+    }
+
+    std::vector<Point3> positions_;
+    std::vector<Vec3> normals_;
+
+    std::vector<u32> indices_;
+    std::vector<u32> normal_indices_;
+
+    MaterialId mat_;
+
+    BVHTree tree_;
+};
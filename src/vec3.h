@@ -3,43 +3,55 @@
 #include <array>
 #include <cassert>
 #include <cmath>
+#include <concepts>
 #include <cstddef>
 #include <ostream>
+#include <type_traits>
+#include <utility>
 
 #include "raytracer.h"
 
-class Vec3 {
+// 3d vector over the scalar type `T`, use the `Vec3` (double) and `Vec3f` (float) aliases
+template <std::floating_point T>
+class BasicVec3 {
    public:
-    static const Vec3 origin;
+    using Scalar = T;
 
-    static const Vec3 e_x;
-    static const Vec3 e_y;
-    static const Vec3 e_z;
+    static const BasicVec3 origin;
 
-    constexpr Vec3(f64 x, f64 y, f64 z) : xyz_{x, y, z} {}
-    constexpr Vec3() : Vec3{0, 0, 0} {}
+    static const BasicVec3 e_x;
+    static const BasicVec3 e_y;
+    static const BasicVec3 e_z;
 
-    constexpr f64& x() { return xyz_[0]; }
-    constexpr f64& y() { return xyz_[1]; }
-    constexpr f64& z() { return xyz_[2]; }
+    constexpr BasicVec3(T x, T y, T z) : xyz_{x, y, z} {}
+    constexpr BasicVec3() : BasicVec3{0, 0, 0} {}
 
-    constexpr f64 x() const { return xyz_[0]; }
-    constexpr f64 y() const { return xyz_[1]; }
-    constexpr f64 z() const { return xyz_[2]; }
+    // change precision, e.g. to trace in float and accumulate in double
+    template <std::floating_point U>
+    constexpr explicit BasicVec3(BasicVec3<U> v)
+        : BasicVec3{static_cast<T>(v.x()), static_cast<T>(v.y()), static_cast<T>(v.z())} {}
 
-    constexpr Vec3 operator-() const { return Vec3{-x(), -y(), -z()}; }
+    constexpr T& x() { return xyz_[0]; }
+    constexpr T& y() { return xyz_[1]; }
+    constexpr T& z() { return xyz_[2]; }
 
-    constexpr f64& operator[](std::size_t i) {
+    constexpr T x() const { return xyz_[0]; }
+    constexpr T y() const { return xyz_[1]; }
+    constexpr T z() const { return xyz_[2]; }
+
+    constexpr BasicVec3 operator-() const { return BasicVec3{-x(), -y(), -z()}; }
+
+    constexpr T& operator[](std::size_t i) {
         assert(i <= 3);
         return xyz_[i];
     }
 
-    constexpr f64 operator[](std::size_t i) const {
+    constexpr T operator[](std::size_t i) const {
         assert(i <= 3);
         return xyz_[i];
     }
 
-    constexpr Vec3& operator+=(Vec3 v) {
+    constexpr BasicVec3& operator+=(BasicVec3 v) {
         x() += v.x();
         y() += v.y();
         z() += v.z();
@@ -47,7 +59,7 @@ class Vec3 {
         return *this;
     }
 
-    constexpr Vec3& operator-=(Vec3 v) {
+    constexpr BasicVec3& operator-=(BasicVec3 v) {
         x() -= v.x();
         y() -= v.y();
         z() -= v.z();
@@ -55,7 +67,7 @@ class Vec3 {
         return *this;
     }
 
-    constexpr Vec3& operator*=(f64 t) {
+    constexpr BasicVec3& operator*=(T t) {
         x() *= t;
         y() *= t;
         z() *= t;
@@ -63,84 +75,134 @@ class Vec3 {
         return *this;
     }
 
-    constexpr Vec3& operator/=(f64 t) {
+    constexpr BasicVec3& operator/=(T t) {
         *this *= 1 / t;
 
         return *this;
     }
 
     constexpr bool almost_zero() const {
-        f64 eps = 1e-8;
+        T eps = static_cast<T>(1e-8);
 
         return std::fabs(x()) < eps && std::fabs(y()) < eps && std::fabs(z()) < eps;
     }
 
-    constexpr f64 squared() const;
+    constexpr T squared() const;
 
-    constexpr f64 norm() const;
+    constexpr T norm() const;
 
-    constexpr Vec3 normed() const;
+    constexpr BasicVec3 normed() const;
 
-    constexpr Vec3 reflect(Vec3 normal) const;
+    constexpr BasicVec3 reflect(BasicVec3 normal) const;
 
-    constexpr Vec3 refract(Vec3 normal, f64 eta) const;
+    constexpr BasicVec3 refract(BasicVec3 normal, T eta) const;
 
    private:
-    std::array<f64, 3> xyz_;
+    std::array<T, 3> xyz_;
 };
 
-constexpr Vec3 Vec3::origin{0.0, 0.0, 0.0};
-constexpr Vec3 Vec3::e_x{1.0, 0.0, 0.0};
-constexpr Vec3 Vec3::e_y{0.0, 1.0, 0.0};
-constexpr Vec3 Vec3::e_z{0.0, 0.0, 1.0};
+template <std::floating_point T>
+constexpr BasicVec3<T> BasicVec3<T>::origin{0, 0, 0};
+template <std::floating_point T>
+constexpr BasicVec3<T> BasicVec3<T>::e_x{1, 0, 0};
+template <std::floating_point T>
+constexpr BasicVec3<T> BasicVec3<T>::e_y{0, 1, 0};
+template <std::floating_point T>
+constexpr BasicVec3<T> BasicVec3<T>::e_z{0, 0, 1};
 
+using Vec3 = BasicVec3<f64>;
 using Point3 = Vec3;
 
-constexpr std::ostream& operator<<(std::ostream& out, Vec3 v) {
+using Vec3f = BasicVec3<f32>;
+using Point3f = Vec3f;
+
+// scalars are taken as `std::type_identity_t<T>` so that e.g. `2 * v` works at either precision
+
+template <std::floating_point T>
+constexpr std::ostream& operator<<(std::ostream& out, BasicVec3<T> v) {
     return out << v.x() << ' ' << v.y() << ' ' << v.z();
 }
 
-constexpr Vec3 operator+(Vec3 u, Vec3 v) {
-    Vec3 out = u;
+template <std::floating_point T>
+constexpr BasicVec3<T> operator+(BasicVec3<T> u, BasicVec3<T> v) {
+    BasicVec3<T> out = u;
     out += v;
     return out;
 }
 
-constexpr Vec3 operator-(Vec3 u, Vec3 v) { return u + (-v); }
+template <std::floating_point T>
+constexpr BasicVec3<T> operator-(BasicVec3<T> u, BasicVec3<T> v) {
+    return u + (-v);
+}
 
-constexpr Vec3 operator*(Vec3 u, Vec3 v) { return {u.x() * v.x(), u.y() * v.y(), u.z() * v.z()}; }
+template <std::floating_point T>
+constexpr BasicVec3<T> operator*(BasicVec3<T> u, BasicVec3<T> v) {
+    return {u.x() * v.x(), u.y() * v.y(), u.z() * v.z()};
+}
 
-constexpr Vec3 operator*(f64 t, Vec3 v) {
-    Vec3 out = v;
+template <std::floating_point T>
+constexpr BasicVec3<T> operator*(std::type_identity_t<T> t, BasicVec3<T> v) {
+    BasicVec3<T> out = v;
     out *= t;
     return out;
 }
 
-constexpr Vec3 operator/(Vec3 v, f64 t) { return (1 / t) * v; }
+template <std::floating_point T>
+constexpr BasicVec3<T> operator/(BasicVec3<T> v, std::type_identity_t<T> t) {
+    return (1 / t) * v;
+}
 
-constexpr f64 dot(Vec3 u, Vec3 v) {
-    Vec3 tmp = u * v;
+template <std::floating_point T>
+constexpr T dot(BasicVec3<T> u, BasicVec3<T> v) {
+    BasicVec3<T> tmp = u * v;
     return tmp.x() + tmp.y() + tmp.z();
 }
 
-constexpr Vec3 cross(Vec3 u, Vec3 v) {
+template <std::floating_point T>
+constexpr BasicVec3<T> cross(BasicVec3<T> u, BasicVec3<T> v) {
     return {u.y() * v.z() - u.z() * v.y(), u.z() * v.x() - u.x() * v.z(),
             u.x() * v.y() - u.y() * v.x()};
 }
 
-constexpr f64 Vec3::squared() const { return dot(*this, *this); }
+template <std::floating_point T>
+constexpr T BasicVec3<T>::squared() const {
+    return dot(*this, *this);
+}
 
-constexpr f64 Vec3::norm() const { return std::sqrt(squared()); }
+template <std::floating_point T>
+constexpr T BasicVec3<T>::norm() const {
+    return std::sqrt(squared());
+}
 
-constexpr Vec3 Vec3::normed() const { return *this / norm(); }
+template <std::floating_point T>
+constexpr BasicVec3<T> BasicVec3<T>::normed() const {
+    return *this / norm();
+}
 
-constexpr Vec3 Vec3::reflect(Vec3 normal) const { return *this - 2 * dot(*this, normal) * normal; }
+template <std::floating_point T>
+constexpr BasicVec3<T> BasicVec3<T>::reflect(BasicVec3 normal) const {
+    return *this - 2 * dot(*this, normal) * normal;
+}
 
-constexpr Vec3 Vec3::refract(Vec3 normal, f64 eta) const {
-    f64 cos_theta = dot(-*this, normal);
+template <std::floating_point T>
+constexpr BasicVec3<T> BasicVec3<T>::refract(BasicVec3 normal, T eta) const {
+    T cos_theta = dot(-*this, normal);
 
-    Vec3 out_orth = eta * (*this + cos_theta * normal);
-    Vec3 out_par = -std::sqrt(std::fabs(1.0 - out_orth.squared())) * normal;
+    BasicVec3 out_orth = eta * (*this + cos_theta * normal);
+    BasicVec3 out_par = -std::sqrt(std::fabs(1 - out_orth.squared())) * normal;
 
     return out_orth + out_par;
 }
+
+// two unit vectors completing the unit vector `n` to a right-handed orthonormal basis, without
+// branches or normalisation (Duff et al., "Building an Orthonormal Basis, Revisited")
+template <std::floating_point T>
+constexpr std::pair<BasicVec3<T>, BasicVec3<T>> OrthonormalBasis(BasicVec3<T> n) {
+    T sign = std::copysign(T{1}, n.z());
+
+    T a = -1 / (sign + n.z());
+    T b = n.x() * n.y() * a;
+
+    return {BasicVec3<T>{1 + sign * n.x() * n.x() * a, sign * b, -sign * n.x()},
+            BasicVec3<T>{b, sign + n.y() * n.y() * a, -n.y()}};
+}
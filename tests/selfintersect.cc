@@ -0,0 +1,276 @@
+// secondary rays and kSelfIntersectEps, at both precisions: a ray spawned from a hit point near
+// kMaxSceneExtent must not hit its own surface again, and a surface just beyond the epsilon must
+// still be hit
+//
+// in double the sphere and rectangle are the scene's own `Sphere` and `Rectangle`. There are no
+// float primitives, so in float the same `BasicRay` tests are done the way those do them.
+
+#include <cmath>
+#include <concepts>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <source_location>
+#include <string_view>
+#include <vector>
+
+#include "2dshapes.h"
+#include "camera.h"
+#include "colour.h"
+#include "interval.h"
+#include "ray.h"
+#include "raytracer.h"
+#include "renderobject.h"
+#include "sphere.h"
+#include "vec3.h"
+
+namespace {
+
+u32 failures = 0;
+
+void Check(bool ok, std::string_view what,
+           std::source_location loc = std::source_location::current()) {
+    if (!ok) {
+        std::cerr << loc.file_name() << ":" << loc.line() << ": " << what << newline;
+        failures++;
+    }
+}
+
+template <std::floating_point T>
+struct SphereAt {
+    BasicVec3<T> centre;
+    T radius;
+
+    std::optional<BasicHitRecord<T>> hit(const BasicRay<T>& ray, BasicInterval<T> ts) const {
+        if constexpr (std::same_as<T, f64>) {
+            return Sphere{centre, radius, 0}.hit(ray, ts);
+        } else {
+            auto t_low_high = ray.HitSphere(centre, radius);
+
+            if (!t_low_high.has_value()) {
+                return std::nullopt;
+            }
+
+            auto [t_low, t_high] = t_low_high.value();
+
+            // same cases as `Sphere::intersect`
+            if (t_low >= ts.max() || (t_low <= ts.min() && !ts.surronds(t_high))) {
+                return std::nullopt;
+            }
+
+            BasicHitRecord<T> hit_record;
+
+            hit_record.t = t_low > ts.min() ? t_low : t_high;
+            hit_record.p = ray.At(hit_record.t);
+            hit_record.normal = (hit_record.p - centre) / radius;
+
+            if (dot(hit_record.normal, ray.direction()) > 0) {
+                hit_record.normal = -hit_record.normal;
+                hit_record.front_face = false;
+            }
+
+            return hit_record;
+        }
+    }
+};
+
+// origin + s * a + t * b, a and b orthogonal
+template <std::floating_point T>
+struct RectangleAt {
+    BasicVec3<T> origin;
+    BasicVec3<T> a;
+    BasicVec3<T> b;
+
+    BasicVec3<T> normal() const { return cross(a, b).normed(); }
+
+    std::optional<BasicHitRecord<T>> hit(const BasicRay<T>& ray, BasicInterval<T> ts) const {
+        if constexpr (std::same_as<T, f64>) {
+            return Rectangle{origin, a, b, 0}.hit(ray, ts);
+        } else {
+            auto t_maybe = ray.HitPlane(origin, normal());
+
+            if (!t_maybe.has_value() || !ts.contains(t_maybe.value())) {
+                return std::nullopt;
+            }
+
+            BasicHitRecord<T> hit_record;
+
+            hit_record.t = t_maybe.value();
+            hit_record.p = ray.At(hit_record.t);
+            hit_record.normal = normal();
+
+            // same bounds as `Rectangle::HitT`
+            T s = dot(hit_record.p - origin, a);
+            T t = dot(hit_record.p - origin, b);
+
+            if (s <= 0 || t <= 0 || s >= a.squared() || t >= b.squared()) {
+                return std::nullopt;
+            }
+
+            return hit_record;
+        }
+    }
+};
+
+// directions up to 75 degrees off `n`: a fixed epsilon can't protect rays that graze the surface,
+// those start behind it whenever the hit point is rounded to the inside
+template <std::floating_point T>
+std::vector<BasicVec3<T>> DirectionsAround(BasicVec3<T> n) {
+    auto [tangent, bitangent] = OrthonormalBasis(n);
+
+    std::vector<BasicVec3<T>> dirs;
+
+    for (u32 i = 0; i <= 5; i++) {
+        T theta = deg2rad(static_cast<T>(15 * i));
+
+        for (u32 j = 0; j < 8; j++) {
+            T phi = deg2rad(static_cast<T>(45 * j));
+
+            dirs.push_back(std::cos(theta) * n + std::sin(theta) * std::cos(phi) * tangent +
+                           std::sin(theta) * std::sin(phi) * bitangent);
+        }
+    }
+
+    return dirs;
+}
+
+// camera rays through every pixel of a small image of `look_at`, seen from `centre`
+template <std::floating_point T>
+std::vector<BasicRay<T>> CameraRays(BasicVec3<T> centre, BasicVec3<T> look_at) {
+    BasicCamera<T> camera{16, 16};
+
+    camera.centre(centre);
+    camera.look_at(look_at);
+    camera.fov(30);
+    camera.Update();
+
+    std::vector<BasicRay<T>> rays;
+
+    for (u32 j = 0; j < camera.image_height(); j++) {
+        for (u32 i = 0; i < camera.image_width(); i++) {
+            BasicVec3<T> pixel = camera.PixelToWorld(static_cast<T>(i), static_cast<T>(j));
+
+            rays.emplace_back(camera.centre(), pixel - camera.centre());
+        }
+    }
+
+    return rays;
+}
+
+template <std::floating_point T>
+void TestSphere() {
+    const T extent = kMaxSceneExtent<T>;
+    const T eps = kSelfIntersectEps<T>;
+
+    const BasicInterval<T> ts{eps, kInfOf<T>};
+
+    SphereAt<T> sphere{BasicVec3<T>{extent - 1, extent - 1, -(extent - 1)}, static_cast<T>(0.5)};
+
+    u32 hits = 0;
+
+    for (const auto& ray : CameraRays(sphere.centre + BasicVec3<T>{0, 1, 4}, sphere.centre)) {
+        auto hit_record = sphere.hit(ray, ts);
+
+        if (!hit_record.has_value()) {
+            continue;
+        }
+
+        hits++;
+
+        Check(hit_record->front_face, "camera ray hits the inside of the sphere");
+
+        // shading by the normal, which has to come out as a colour in [0, 1]
+        BasicColour<T> colour{static_cast<T>(0.5) * (hit_record->normal.x() + 1),
+                              static_cast<T>(0.5) * (hit_record->normal.y() + 1),
+                              static_cast<T>(0.5) * (hit_record->normal.z() + 1)};
+
+        Check(colour.luminance() >= 0 && colour.luminance() <= static_cast<T>(1.0001),
+              "normal is not a unit vector");
+
+        for (auto dir : DirectionsAround(hit_record->normal)) {
+            // reflected: leaves the sphere for good
+            Check(!sphere.hit(BasicRay<T>{hit_record->p, dir}, ts).has_value(),
+                  "reflected ray hits the sphere it leaves");
+
+            // refracted: goes through to the far side, a chord of 2 r cos away
+            auto far = sphere.hit(BasicRay<T>{hit_record->p, -dir}, ts);
+
+            Check(far.has_value() && !far->front_face &&
+                      far->t > sphere.radius * dot(dir, hit_record->normal),
+                  "refracted ray hits the sphere where it enters");
+        }
+    }
+
+    Check(hits > 0, "camera misses the sphere");
+
+    // a point just outside the epsilon still sees the surface in front of it
+    for (auto n : DirectionsAround(BasicVec3<T>::e_y)) {
+        BasicVec3<T> p = sphere.centre + (sphere.radius + 2 * eps) * n;
+
+        Check(sphere.hit(BasicRay<T>{p, -n}, ts).has_value(),
+              "sphere just beyond the epsilon is missed");
+    }
+}
+
+template <std::floating_point T>
+void TestRectangle() {
+    const T extent = kMaxSceneExtent<T>;
+    const T eps = kSelfIntersectEps<T>;
+
+    const BasicInterval<T> ts{eps, kInfOf<T>};
+
+    RectangleAt<T> rect{BasicVec3<T>{extent - 2, extent - 2, -(extent - 1)},
+                        BasicVec3<T>::e_x, BasicVec3<T>::e_y};
+
+    BasicVec3<T> middle = rect.origin + static_cast<T>(0.5) * (rect.a + rect.b);
+
+    u32 hits = 0;
+
+    for (const auto& ray : CameraRays(middle + BasicVec3<T>{1, 1, 3}, middle)) {
+        auto hit_record = rect.hit(ray, ts);
+
+        if (!hit_record.has_value()) {
+            continue;
+        }
+
+        hits++;
+
+        // whichever side a spawned ray leaves to, it never comes back
+        for (auto n : {hit_record->normal, -hit_record->normal}) {
+            for (auto dir : DirectionsAround(n)) {
+                Check(!rect.hit(BasicRay<T>{hit_record->p, dir}, ts).has_value(),
+                      "spawned ray hits the rectangle it leaves");
+            }
+        }
+    }
+
+    Check(hits > 0, "camera misses the rectangle");
+
+    // from either side, a point just outside the epsilon still sees the rectangle
+    for (auto n : {rect.normal(), -rect.normal()}) {
+        for (auto dir : DirectionsAround(-n)) {
+            BasicVec3<T> p = middle - 2 * eps / dot(dir, -n) * dir;
+
+            Check(rect.hit(BasicRay<T>{p, dir}, ts).has_value(),
+                  "rectangle just beyond the epsilon is missed");
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    TestSphere<f64>();
+    TestRectangle<f64>();
+
+    TestSphere<f32>();
+    TestRectangle<f32>();
+
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << newline;
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
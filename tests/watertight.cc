@@ -0,0 +1,87 @@
+// the watertight triangle test: rays from inside a closed mesh, aimed exactly at its vertices and
+// at points on its edges, must hit it. These are the rays that slip through between two triangles
+// whenever the neighbours disagree about the edge they share.
+
+#include <cstdlib>
+#include <iostream>
+#include <source_location>
+#include <string_view>
+
+#include "interval.h"
+#include "ray.h"
+#include "raytracer.h"
+#include "scenes.h"
+#include "trianglemesh.h"
+#include "vec3.h"
+
+namespace {
+
+u32 failures = 0;
+
+void Check(bool ok, std::string_view what,
+           std::source_location loc = std::source_location::current()) {
+    if (!ok) {
+        std::cerr << loc.file_name() << ":" << loc.line() << ": " << what << newline;
+        failures++;
+    }
+}
+
+// rays from `origin` through every vertex of `mesh` and through points along every edge, the
+// number of them that miss
+u32 Leaks(const TriangleMesh& mesh, Point3 origin) {
+    auto positions = mesh.positions();
+    auto indices = mesh.indices();
+
+    const Interval ts{0.0, kInf};
+
+    u32 misses = 0;
+
+    auto cast = [&](Point3 target) {
+        if (!mesh.hit(Ray{origin, target - origin}, ts).has_value()) {
+            misses++;
+        }
+    };
+
+    for (auto p : positions) {
+        cast(p);
+    }
+
+    for (std::size_t i = 0; i < indices.size(); i += 3) {
+        for (std::size_t k = 0; k < 3; k++) {
+            Point3 p = positions[indices[i + k]];
+            Point3 q = positions[indices[i + (k + 1) % 3]];
+
+            for (f64 s : {0.5, 1.0 / 3.0, 0.1}) {
+                cast(p + s * (q - p));
+            }
+        }
+    }
+
+    return misses;
+}
+
+}  // namespace
+
+int main() {
+    const Point3 centre{0.3, -0.2, 0.1};
+
+    auto mesh = scenes_detail::SphereMesh(centre, 1.0, 100, 200, 0);
+
+    Check(Leaks(mesh, centre) == 0, "rays from the centre slip through the mesh");
+    Check(Leaks(mesh, centre + Vec3{0.31, 0.17, -0.23}) == 0,
+          "rays from off the centre slip through the mesh");
+
+    // far from the origin, where the edges are evaluated with large coordinates
+    auto far_mesh = scenes_detail::SphereMesh(centre + Vec3{700, -300, 500}, 5.0, 60, 90, 0);
+
+    Check(Leaks(far_mesh, centre + Vec3{700, -300, 500}) == 0,
+          "rays slip through a mesh far from the origin");
+
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << newline;
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}